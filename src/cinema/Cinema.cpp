@@ -6,6 +6,10 @@
 #include <vector>
 
 #include "Cinema.h"
+#include "Timer.h"
+#include "Trace.h"
+#include "Commits.h"
+#include "TileCull.h"
 
 using namespace std;
 using namespace rapidjson;
@@ -371,40 +375,24 @@ void CameraVariable::Render(Renderer& r, string s, Document& doc)
 			else
 				s2 = s1;
 
-			RenderShot(r, s2, doc);
+			RenderShot(r, s2, doc, thetas[i], phis[j]);
 		}
 	}
 }
 
-void CameraVariable::RenderShot(Renderer& r, string s, Document& doc)
+void CameraVariable::RenderShot(Renderer& r, string s, Document& doc, int theta, int phi)
 {
-	struct stat info;
-
-	if (cinema->getSaveState())
-		r.SaveState((s + ".state").c_str());
-
-	if (stat((s + ".png").c_str(), &info))
+	if (cinema->collecting())
 	{
-		r.getSlices().commit(r.getRenderer(), r.getVolume());
-		r.getIsos().commit(r.getVolume());
-		r.getCamera().commit();
-		// r.getTransferFunction().commit(r.getRenderer());
-		r.Render(s + ".png");
-
-		StringBuffer sbuf;
-		PrettyWriter<StringBuffer> writer(sbuf);
-		doc.Accept(writer);
-		
-		ofstream out;
-		out.open((s + ".__data__").c_str(), ofstream::out);
-		out << sbuf.GetString() << "\n";
-		out.close();
-
-		if (knt != -1)
-			std::cerr << knt++ <<  " (" << (s + ".png").c_str() << ") done\n";
+		cinema->AddJob(r, s, doc, theta, phi, &knt);
+		return;
 	}
-	else if (knt != -1)
-			std::cerr << knt++ << " (" << (s + ".png").c_str() << ") skipped\n";
+
+	StringBuffer sbuf;
+	PrettyWriter<StringBuffer> writer(sbuf);
+	doc.Accept(writer);
+
+	cinema->Shot(r, s, sbuf.GetString(), &knt);
 }
 
 string CameraVariable::GatherTemplate(string s, Document& doc)
@@ -467,8 +455,11 @@ string VolumeRenderingVariable::GatherTemplate(string s, Document& doc)
 
 //===================================================
 
-Cinema::Cinema(int *argc, const char **argv) : variableStack(NULL), saveState(false)
+Cinema::Cinema(int *argc, const char **argv) : variableStack(NULL), saveState(false),
+	lanes(1), jobs(NULL), nextJob(0),
+	commitTime(0), metadataTime(0), startTime(WallClock())
 {
+	pthread_mutex_init(&lock, NULL);
   ospInit(argc, (const char **)argv);
 }
 
@@ -480,6 +471,8 @@ Cinema::~Cinema()
 		vn = v->getDown();
 		// delete v;
 	}
+
+	pthread_mutex_destroy(&lock);
 }
 
 void
@@ -510,7 +503,197 @@ Cinema::Render(Renderer& r, int timestep)
 	sprintf(buf, "cinema_%d", timestep);
 
 	variableStack->ReInitialize(r);
+
+	if (lanes > 1 && ! r.getVolume()->CanShare())
+		std::cerr << "volume can't be shared between renderers; using one\n";
+
+	if (lanes <= 1 || ! r.getVolume()->CanShare())
+	{
+		variableStack->Render(r, string(buf), doc);
+		return;
+	}
+
+	// Walk the variables once to list every image with the state it
+	// needs, then hand the list out to the lanes
+
+	vector<CinemaJob> list;
+	jobs = &list;
 	variableStack->Render(r, string(buf), doc);
+	jobs = NULL;
+
+	RenderJobs(r, list);
+}
+
+void
+Cinema::AddJob(Renderer& r, string name, Document& doc, int theta, int phi, int *counter)
+{
+	CinemaJob job;
+
+	StringBuffer sbuf;
+	PrettyWriter<StringBuffer> writer(sbuf);
+	doc.Accept(writer);
+
+	job.name = name;
+	job.data = sbuf.GetString();
+	job.slices = r.getSlices();
+	job.isos = r.getIsos();
+	job.volumeRendering = r.getTransferFunction().GetDoVolumeRendering();
+	job.theta = theta;
+	job.phi = phi;
+	job.counter = counter;
+
+	jobs->push_back(job);
+}
+
+// Render one image.  OSPRay object updates are made under the lock, since
+// lanes may be doing this concurrently; the frame itself renders outside it.
+
+void
+Cinema::Shot(Renderer& r, string s, const string& data, int *counter)
+{
+	struct stat info;
+
+	if (saveState)
+		r.SaveState((s + ".state").c_str());
+
+	if (stat((s + ".png").c_str(), &info))
+	{
+		double t0 = WallClock();
+
+		pthread_mutex_lock(&lock);
+		r.getSlices().commit(r.getRenderer(), r.getVolume());
+		r.getIsos().commit(r.getVolume());
+		r.getVolume()->commit();
+		r.getCamera().commit();
+		// r.getTransferFunction().commit(r.getRenderer());
+		pthread_mutex_unlock(&lock);
+
+		double t1 = WallClock();
+
+		r.Render(s + ".png");
+
+		double t2 = WallClock();
+
+		{
+			TraceScope trace(TRACE_METADATA);
+			ofstream out;
+			out.open((s + ".__data__").c_str(), ofstream::out);
+			out << data << "\n";
+			out.close();
+		}
+
+		pthread_mutex_lock(&lock);
+		addTimes(t1 - t0, WallClock() - t2);
+		if (*counter != -1)
+			std::cerr << (*counter)++ <<  " (" << (s + ".png").c_str() << ") done\n";
+		pthread_mutex_unlock(&lock);
+	}
+	else
+	{
+		pthread_mutex_lock(&lock);
+		if (*counter != -1)
+			std::cerr << (*counter)++ << " (" << (s + ".png").c_str() << ") skipped\n";
+		pthread_mutex_unlock(&lock);
+	}
+}
+
+void
+Cinema::RunLane(Renderer& r, vector<CinemaJob>& list)
+{
+	for (;;)
+	{
+		int i = __sync_fetch_and_add(&nextJob, 1);
+		if (i >= (int)list.size())
+			break;
+
+		CinemaJob& job = list[i];
+
+		r.getSlices().CopySettings(job.slices);
+		r.getIsos() = job.isos;
+		r.getTransferFunction().SetDoVolumeRendering(job.volumeRendering);
+		r.getCamera().setTheta(job.theta);
+		r.getCamera().setPhi(job.phi);
+
+		Shot(r, job.name, job.data, job.counter);
+	}
+}
+
+struct LaneArgs
+{
+	Cinema *cinema;
+	Renderer *renderer;
+	vector<CinemaJob> *jobs;
+};
+
+static void *
+lane_thread(void *p)
+{
+	LaneArgs *a = (LaneArgs *)p;
+	a->cinema->RunLane(*a->renderer, *a->jobs);
+	return NULL;
+}
+
+// r is lane 0 and runs on the calling thread.  The other lanes get
+// renderers of their own, set up before any thread starts since OSPRay
+// object creation isn't thread safe, and released once the sweep is done.
+
+void
+Cinema::RenderJobs(Renderer& r, vector<CinemaJob>& list)
+{
+	int n = lanes < (int)list.size() ? lanes : (int)list.size();
+	if (n < 1)
+		return;
+
+	vector<Renderer *> renderers(1, &r);
+	for (int i = 1; i < n; i++)
+		renderers.push_back(new Renderer(r));
+
+	vector<LaneArgs> args(n);
+	vector<pthread_t> threads(n);
+
+	nextJob = 0;
+	for (int i = 0; i < n; i++)
+	{
+		renderers[i]->SetLock(&lock);
+		args[i].cinema = this;
+		args[i].renderer = renderers[i];
+		args[i].jobs = &list;
+	}
+
+	for (int i = 1; i < n; i++)
+		pthread_create(&threads[i], NULL, lane_thread, (void *)&args[i]);
+
+	lane_thread((void *)&args[0]);
+
+	for (int i = 1; i < n; i++)
+		pthread_join(threads[i], NULL);
+
+	r.SetLock(NULL);
+
+	for (int i = 1; i < n; i++)
+	{
+		renderers[i]->getWindow()->finish();
+		laneReports << "lane " << i << " ";
+		renderers[i]->getWindow()->report(laneReports);
+		delete renderers[i];
+	}
+}
+
+void
+Cinema::Report(Renderer& r, std::ostream& o)
+{
+	r.getWindow()->finish();
+
+	o << "total: " << WallClock() - startTime << " s\n";
+	o << "commit: " << commitTime << " s\n";
+	o << "metadata: " << metadataTime << " s\n";
+	if (lanes > 1)
+		o << "lane 0 ";
+	r.getWindow()->report(o);
+	o << laneReports.str();
+	ReportCommits(o);
+	ReportCulledTiles(o);
+	ReportTrace(o);
 }
 
 void
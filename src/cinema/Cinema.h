@@ -1,4 +1,6 @@
 #include <vector>
+#include <sstream>
+#include <pthread.h>
 #include "ospray/include/ospray/ospray.h"
 #include "../common/common.h"
 
@@ -48,7 +50,7 @@ public:
 	}
 
 protected:
-	void RenderShot(Renderer&, string, Document&);
+	void RenderShot(Renderer&, string, Document&, int theta, int phi);
 
 	int knt;
 
@@ -112,6 +114,20 @@ private:
 	vector<int> values;
 };
 
+// One image of a sweep: its file name prefix, its .__data__ contents and
+// the state the variables above the camera set up for it
+
+struct CinemaJob
+{
+	string name;
+	string data;
+	Slices slices;
+	Isos   isos;
+	bool   volumeRendering;
+	int    theta, phi;
+	int    *counter;
+};
+
 class Cinema 
 {
 public:
@@ -129,9 +145,37 @@ public:
 		void setSaveState(bool s) { saveState = s; }
 		bool getSaveState() { return saveState; }
 
+		// Render the images of a sweep on this many renderers at once,
+		// each with its own framebuffers and state but sharing the volume
+		void setLanes(int n) { lanes = n; }
+
+		// Used by CameraVariable.  While Render is collecting jobs for
+		// the lanes, shots are queued rather than rendered.
+		bool collecting() { return jobs != NULL; }
+		void AddJob(Renderer&, string name, Document& doc, int theta, int phi, int *counter);
+		void Shot(Renderer&, string name, const string& data, int *counter);
+
+		void RunLane(Renderer&, vector<CinemaJob>&);
+
+		// Per-stage timings: state commits, .__data__ writes, then what
+		// the window has for rendering and PNG output, and the counts of
+		// OSPRay commits made and avoided.  Waits for queued images first.
+		void addTimes(double commit, double metadata) { commitTime += commit; metadataTime += metadata; }
+		void Report(Renderer& r, std::ostream& o);
+
 private:
+		void RenderJobs(Renderer&, vector<CinemaJob>&);
+
 		Variable *variableStack;
 		vector<int> timesteps;
 		bool saveState;
+
+		int lanes;
+		vector<CinemaJob> *jobs;
+		int nextJob;
+		pthread_mutex_t lock;
+
+		double commitTime, metadataTime, startTime;
+		std::stringstream laneReports;
 };
 
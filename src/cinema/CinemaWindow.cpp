@@ -4,6 +4,10 @@
 
 #include <iostream>
 
+#include "PNGQueue.h"
+#include "Timer.h"
+#include "Trace.h"
+
 #if WITH_DISPLAY_WINDOW
 
 #define GL_GLEXT_PROTOTYPES
@@ -67,9 +71,120 @@ bool
 CinemaWindow::createDisplay() {return true;}
 #endif
 
+CinemaWindow::CinemaWindow(int w, int h) :
+	width(w), height(h), current(0), queue(NULL),
+	encodeThreads(2), encodeLevel(-1), encodeFilters(0),
+	nFrames(0), renderTime(0), mapTime(0), show(false)
+{
+	osp::vec2i sz(width, height);
+	for (int i = 0; i < 2; i++)
+	{
+		frameBuffer[i] = ospNewFrameBuffer(sz, OSP_RGBA_I8);
+		mapped[i] = NULL;
+		ticket[i] = -1;
+	}
+}
+
+CinemaWindow::~CinemaWindow()
+{
+	finish();
+	delete queue;
+
+	ospFreeFrameBuffer(frameBuffer[0]);
+	ospFreeFrameBuffer(frameBuffer[1]);
+}
+
+void
+CinemaWindow::setEncoder(int threads, int level, int filters)
+{
+	if (queue)
+	{
+		std::cerr << "encoder settings must be made before the first image is saved\n";
+		return;
+	}
+
+	encodeThreads = threads;
+	encodeLevel = level;
+	encodeFilters = filters;
+}
+
+// Once the encoder has its copy, framebuffer i can be unmapped and
+// rendered into again
+
+void
+CinemaWindow::release(int i)
+{
+	if (! mapped[i])
+		return;
+
+	queue->WaitCopied(ticket[i]);
+	ospUnmapFrameBuffer(mapped[i], frameBuffer[i]);
+	mapped[i] = NULL;
+}
+
+void
+CinemaWindow::render(OSPRenderer r)
+{
+	release(current);
+
+	double t0 = WallClock();
+	{
+		TraceScope trace(TRACE_RENDER_FRAME);
+		ospRenderFrame(frameBuffer[current], r);
+	}
+	renderTime += WallClock() - t0;
+	nFrames++;
+}
+
+void
+CinemaWindow::finish()
+{
+	release(0);
+	release(1);
+	if (queue)
+		queue->Finish();
+}
+
+void
+CinemaWindow::report(std::ostream& o)
+{
+	o << "render: " << nFrames << " frames, " << renderTime << " s";
+	if (nFrames)
+		o << " (" << renderTime / nFrames << " s/frame)";
+	o << "\n  map:     " << mapTime << " s\n";
+	if (queue)
+		queue->Report(o);
+}
+
 void CinemaWindow::save(std::string filename)
 {
-	unsigned int *mappedFrameBuffer = (unsigned int *)ospMapFrameBuffer(frameBuffer);
+	unsigned int *mappedFrameBuffer = map();
+	ticket[current] = queue->Submit(filename, width, height, mappedFrameBuffer);
+	current ^= 1;
+}
+
+void CinemaWindow::save(PNGSink *sink)
+{
+	unsigned int *mappedFrameBuffer = map();
+	ticket[current] = queue->Submit(sink, width, height, mappedFrameBuffer);
+	current ^= 1;
+}
+
+// Map the frame just rendered (and show it) ready to go to the encoder
+
+unsigned int *
+CinemaWindow::map()
+{
+	if (! queue)
+		queue = new PNGQueue(encodeThreads, encodeLevel, encodeFilters);
+
+	double t0 = WallClock();
+	unsigned int *mappedFrameBuffer;
+	{
+		TraceScope trace(TRACE_MAP_FRAMEBUFFER);
+		mappedFrameBuffer = (unsigned int *)ospMapFrameBuffer(frameBuffer[current]);
+	}
+	mapTime += WallClock() - t0;
 
 #if WITH_DISPLAY_WINDOW
 	if (show && !dpy)
@@ -82,14 +197,7 @@ void CinemaWindow::save(std::string filename)
     glFlush();
 	}
 #endif
-		
-	unsigned int *buf = new unsigned int[width*height];
-	for (int i = 0; i < width*height; i++)
-		buf[i] = (mappedFrameBuffer[i] == 0) ? 0xff010101 : mappedFrameBuffer[i];
-
-	write_png(filename.c_str(), width, height, buf);
-
-	delete[] buf;
 
-	ospUnmapFrameBuffer(mappedFrameBuffer, frameBuffer);
+	mapped[current] = mappedFrameBuffer;
+	return mappedFrameBuffer;
 }
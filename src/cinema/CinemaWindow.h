@@ -1,27 +1,40 @@
 #pragma once
 
 #include <ospray/ospray.h>
+#include <iostream>
 #include "cinema_cfg.h"
 
+class PNGQueue;
+class PNGSink;
+
+// Frames are rendered into two framebuffers in turn.  save() hands the
+// finished one to the PNG encoder threads and the next render goes into
+// the other, so encoding overlaps rendering.
+
 class CinemaWindow
 {
 public:
 
-	CinemaWindow(int w = 1920, int h = 1080) : 
-		width(w), height(h), show(false)
-	{
-		osp::vec2i sz(width, height);
-		frameBuffer = ospNewFrameBuffer(sz, OSP_RGBA_I8);
-	}
-
-	~CinemaWindow()
-	{
-		ospFreeFrameBuffer(frameBuffer);
-	}
+	CinemaWindow(int w = 1920, int h = 1080);
+	~CinemaWindow();
 
-	void render(OSPRenderer r) {ospRenderFrame(frameBuffer, r);}
+	void render(OSPRenderer r);
 	void save(std::string filename);
 
+	// Encode in memory and hand the PNG to sink
+	void save(PNGSink *sink);
+
+	// Encoder threads (0: encode in save()), zlib level (-1: default)
+	// and PNG filter mask (0: default).  Call before the first save.
+	void setEncoder(int threads, int level, int filters);
+	void getEncoder(int& threads, int& level, int& filters) { threads = encodeThreads; level = encodeLevel; filters = encodeFilters; }
+
+	// Wait for all queued images to be written
+	void finish();
+
+	// Per-stage timings so far
+	void report(std::ostream& o);
+
 	void setShow(bool a) { show = a; }
 
 	void getSize(int& w, int& h) { w = width; h = height; }
@@ -30,9 +43,20 @@ protected:
 	bool createDisplay();
 
 private:
+	void release(int i);
+	unsigned int *map();
+
 	int width, height;
-	OSPFrameBuffer frameBuffer;
+	OSPFrameBuffer frameBuffer[2];
+	unsigned int *mapped[2];
+	int ticket[2];
+	int current;
+
+	PNGQueue *queue;
+	int encodeThreads, encodeLevel, encodeFilters;
+
+	int nFrames;
+	double renderTime, mapTime;
 
 	bool show;
 };
-
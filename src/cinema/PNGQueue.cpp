@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <png.h>
+
+#include "PNGQueue.h"
+#include "Timer.h"
+#include "Trace.h"
+#include "mypng.h"
+
+PNGQueue::PNGQueue(int nthreads, int l, int f) :
+	level(l), filters(f), nextTicket(0), inflight(0), quit(false),
+	copyTime(0), encodeTime(0), stallTime(0), nFrames(0)
+{
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&work, NULL);
+	pthread_cond_init(&copied, NULL);
+	pthread_cond_init(&done, NULL);
+
+	for (int i = 0; i < nthreads; i++)
+	{
+		pthread_t t;
+		if (pthread_create(&t, NULL, worker, (void *)this) == 0)
+			threads.push_back(t);
+	}
+}
+
+PNGQueue::~PNGQueue()
+{
+	Finish();
+
+	pthread_mutex_lock(&lock);
+	quit = true;
+	pthread_cond_broadcast(&work);
+	pthread_mutex_unlock(&lock);
+
+	for (size_t i = 0; i < threads.size(); i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_cond_destroy(&work);
+	pthread_cond_destroy(&copied);
+	pthread_cond_destroy(&done);
+	pthread_mutex_destroy(&lock);
+}
+
+// Copy out the pixels (the caller's buffer is released as soon as this
+// is done), then compress and write
+
+void
+PNGQueue::encode(Job& job, std::vector<unsigned int>& buf)
+{
+	double t0 = WallClock();
+
+	{
+		TraceScope trace(TRACE_PIXEL_FIXUP);
+		size_t n = ((size_t)job.w) * job.h;
+		buf.resize(n);
+		for (size_t i = 0; i < n; i++)
+			buf[i] = (job.rgba[i] == 0) ? 0xff010101 : job.rgba[i];
+	}
+
+	double t1 = WallClock();
+
+	pthread_mutex_lock(&lock);
+	uncopied.erase(job.ticket);
+	copyTime += t1 - t0;
+	pthread_cond_broadcast(&copied);
+	pthread_mutex_unlock(&lock);
+
+	if (job.sink)
+	{
+		std::vector<unsigned char> png;
+		bool ok;
+		{
+			TraceScope trace(TRACE_PNG_ENCODE);
+			ok = write_png(png, job.w, job.h, &buf[0], level, filters);
+		}
+		job.sink->Encoded(ok, png);
+	}
+	else
+	{
+		TraceScope trace(TRACE_PNG_ENCODE);
+		if (! write_png(job.filename.c_str(), job.w, job.h, &buf[0], level, filters))
+			std::cerr << "failed to write " << job.filename << "\n";
+	}
+
+	double t2 = WallClock();
+
+	pthread_mutex_lock(&lock);
+	encodeTime += t2 - t1;
+	nFrames++;
+	pthread_mutex_unlock(&lock);
+}
+
+int
+PNGQueue::Submit(const std::string& filename, int w, int h, const unsigned int *rgba)
+{
+	Job job;
+	job.filename = filename;
+	job.sink = NULL;
+	job.w = w;
+	job.h = h;
+	job.rgba = rgba;
+
+	return submit(job);
+}
+
+int
+PNGQueue::Submit(PNGSink *sink, int w, int h, const unsigned int *rgba)
+{
+	Job job;
+	job.sink = sink;
+	job.w = w;
+	job.h = h;
+	job.rgba = rgba;
+
+	return submit(job);
+}
+
+int
+PNGQueue::submit(Job& job)
+{
+	pthread_mutex_lock(&lock);
+	job.ticket = nextTicket++;
+	uncopied.insert(job.ticket);
+
+	if (threads.empty())
+	{
+		pthread_mutex_unlock(&lock);
+
+		encode(job, syncBuffer);
+		return job.ticket;
+	}
+
+	jobs.push_back(job);
+	pthread_cond_signal(&work);
+	pthread_mutex_unlock(&lock);
+
+	return job.ticket;
+}
+
+void
+PNGQueue::WaitCopied(int ticket)
+{
+	double t0 = WallClock();
+
+	pthread_mutex_lock(&lock);
+	while (uncopied.count(ticket))
+		pthread_cond_wait(&copied, &lock);
+	stallTime += WallClock() - t0;
+	pthread_mutex_unlock(&lock);
+}
+
+void
+PNGQueue::Finish()
+{
+	double t0 = WallClock();
+
+	pthread_mutex_lock(&lock);
+	while (jobs.size() || inflight)
+		pthread_cond_wait(&done, &lock);
+	stallTime += WallClock() - t0;
+	pthread_mutex_unlock(&lock);
+}
+
+void
+PNGQueue::Report(std::ostream& o)
+{
+	pthread_mutex_lock(&lock);
+	o << "png: " << nFrames << " images, " << threads.size() << " encoder threads\n";
+	o << "  copy:    " << copyTime << " s\n";
+	o << "  encode:  " << encodeTime << " s (summed over threads)\n";
+	o << "  stalled: " << stallTime << " s waiting for encoders\n";
+	pthread_mutex_unlock(&lock);
+}
+
+int
+PNGQueue::ParseFilters(const std::string& s)
+{
+	int mask = 0;
+
+	size_t b = 0;
+	while (b <= s.size())
+	{
+		size_t e = s.find(',', b);
+		if (e == std::string::npos)
+			e = s.size();
+
+		std::string f = s.substr(b, e - b);
+		if (f == "none")				mask |= PNG_FILTER_NONE;
+		else if (f == "sub")		mask |= PNG_FILTER_SUB;
+		else if (f == "up")			mask |= PNG_FILTER_UP;
+		else if (f == "avg")		mask |= PNG_FILTER_AVG;
+		else if (f == "paeth")	mask |= PNG_FILTER_PAETH;
+		else if (f == "all")		mask |= PNG_ALL_FILTERS;
+		else return -1;
+
+		b = e + 1;
+	}
+
+	return mask;
+}
+
+void *
+PNGQueue::worker(void *p)
+{
+	((PNGQueue *)p)->run();
+	return NULL;
+}
+
+void
+PNGQueue::run()
+{
+	std::vector<unsigned int> buf;
+
+	pthread_mutex_lock(&lock);
+
+	while (! quit)
+	{
+		if (jobs.empty())
+		{
+			pthread_cond_wait(&work, &lock);
+			continue;
+		}
+
+		Job job = jobs.front();
+		jobs.pop_front();
+		inflight++;
+		pthread_mutex_unlock(&lock);
+
+		encode(job, buf);
+
+		pthread_mutex_lock(&lock);
+		inflight--;
+		pthread_cond_broadcast(&done);
+	}
+
+	pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <pthread.h>
+#include <deque>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+// Encodes PNGs on worker threads so rendering can carry on.  Submit
+// hands over an image that stays owned by the caller until the ticket
+// it returns has been copied (see WaitCopied); encoding and writing
+// happen afterwards.  Background pixels (0) are written as 0xff010101,
+// as CinemaWindow always has.
+//
+// With no threads, Submit does all the work before returning.
+//
+// Images submitted with a PNGSink rather than a filename are encoded in
+// memory and handed to the sink, on whichever thread encoded them.
+
+class PNGSink
+{
+public:
+	virtual ~PNGSink() {}
+
+	// ok is false if the image couldn't be encoded; png is the sink's to
+	// keep (swap it out)
+	virtual void Encoded(bool ok, std::vector<unsigned char>& png) = 0;
+};
+
+class PNGQueue
+{
+public:
+	PNGQueue(int nthreads, int level = -1, int filters = 0);
+	~PNGQueue();
+
+	int  Submit(const std::string& filename, int w, int h, const unsigned int *rgba);
+	int  Submit(PNGSink *sink, int w, int h, const unsigned int *rgba);
+	void WaitCopied(int ticket);
+
+	// Wait for everything submitted to be written
+	void Finish();
+
+	void Report(std::ostream& o);
+
+	// Comma separated list of none, sub, up, avg, paeth or all to a
+	// PNG filter mask; -1 if unrecognized
+	static int ParseFilters(const std::string& s);
+
+private:
+	struct Job
+	{
+		int									ticket;
+		std::string					filename;
+		PNGSink						 *sink;
+		int									w, h;
+		const unsigned int *rgba;
+	};
+
+	static void *worker(void *);
+	void run();
+	int  submit(Job& job);
+	void encode(Job& job, std::vector<unsigned int>& buf);
+
+	int									level, filters;
+	int									nextTicket;
+	std::deque<Job>			jobs;
+	std::set<int>				uncopied;
+	int									inflight;
+	bool								quit;
+
+	// Seconds, summed over workers
+	double							copyTime, encodeTime, stallTime;
+	int									nFrames;
+
+	std::vector<unsigned int> syncBuffer;
+
+	std::vector<pthread_t> threads;
+	pthread_mutex_t			lock;
+	pthread_cond_t			work, copied, done;
+};
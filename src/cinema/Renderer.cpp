@@ -1,9 +1,46 @@
 #include <iostream>
 #include <fstream>
+#include <stdlib.h>
+#include <string.h>
 
 #include "Renderer.h"
+#include "Commits.h"
+#include "TileCull.h"
+#include "Trace.h"
 
-Renderer::Renderer(int width, int height)
+Renderer::Renderer(int width, int height) : lock(NULL), level(0), committedAt(-1), culled(false)
+{
+	Initialize(width, height);
+}
+
+Renderer::Renderer(Renderer& master) : lock(NULL), level(master.level), committedAt(-1), culled(false)
+{
+	int w, h, threads, compression, filters;
+	master.getWindow()->getSize(w, h);
+	Initialize(w, h);
+
+	master.getWindow()->getEncoder(threads, compression, filters);
+	window->setEncoder(threads, compression, filters);
+
+	// Same steps as master took, in the same order, so the committed
+	// state matches bit for bit
+
+	if (master.stateFile != "")
+		LoadState(master.stateFile, false);
+
+	volume.Share(master.volume, getTransferFunction());
+	CommitVolume();
+
+	if (master.stateFile == "")
+		SetupDefaultView();
+
+	// May have been set on the command line rather than in the state file
+	getTransferFunction().SetPreintegration(master.getTransferFunction().GetPreintegration());
+	getTransferFunction().commit(getRenderer());
+}
+
+void
+Renderer::Initialize(int width, int height)
 {
 	renderer = ospNewRenderer("vis_renderer");
 	camera.setRenderer(renderer);
@@ -50,12 +87,23 @@ Renderer::CommitVolume()
 	volume.commit();
 
 	OSPModel model = ospNewModel();
-	ospAddVolume(model, volume.getOSPVolume());
+	ospAddVolume(model, volume.GetLevel(level)->getOSPVolume());
 	ospCommit(model);
 	ospSetObject(getRenderer(), "model", model);
+	ospRelease(model);
 	ospCommit(getRenderer());
 }
 
+void
+Renderer::SetLevel(int l)
+{
+	if (l > 0 && volume.GetNumberOfLevels() <= l && ! volume.BuildPyramid(l, getenv("VOLVIEWER_LOD_CACHE") != NULL))
+		std::cerr << "can't build pyramid level " << l << "; rendering from level " << volume.GetNumberOfLevels() - 1 << "\n";
+
+	level = l;
+	CommitVolume();
+}
+
 void
 Renderer::LoadDataFromFile(std::string volumeName)
 {
@@ -66,8 +114,14 @@ Renderer::LoadDataFromFile(std::string volumeName)
 void
 Renderer::LoadVolume(std::string volumeName)
 {
+	stateFile = "";
 	LoadDataFromFile(volumeName);
+	SetupDefaultView();
+}
 
+void
+Renderer::SetupDefaultView()
+{
 	int x, y, z;
   volume.GetDimensions(x, y, z);
 
@@ -86,7 +140,6 @@ Renderer::LoadVolume(std::string volumeName)
 	getSlices().commit(getRenderer(), &volume);
 	getIsos().commit(&volume);
 	renderProperties.commit();
-	
 }
 
 static char xyzzy[10240];
@@ -94,6 +147,8 @@ static char xyzzy[10240];
 void
 Renderer::LoadState(std::string statefile, bool with_data)
 {
+	TraceScope trace(TRACE_STATE_FILE);
+
   Document doc;
 
   std::ifstream in;
@@ -112,50 +167,56 @@ Renderer::LoadState(std::string statefile, bool with_data)
     return;
   }
 
-	if (doc["State"].HasMember("Camera")) 
+	ApplyState(doc["State"], with_data);
+}
+
+void
+Renderer::ApplyState(Value& state, bool with_data)
+{
+	if (state.HasMember("Camera")) 
 	{
-		getCamera().loadState(doc["State"]["Camera"]);
+		getCamera().loadState(state["Camera"]);
 		getCamera().commit();
 	}
 
-	if (doc["State"].HasMember("Lights")) 
+	if (state.HasMember("Lights")) 
 	{
-		getLights().loadState(doc["State"]["Lights"]);
+		getLights().loadState(state["Lights"]);
 		getLights().commit(getRenderer());
 	}
 
-	if (doc["State"].HasMember("TransferFunction")) 
+	if (state.HasMember("TransferFunction")) 
 	{
-		getTransferFunction().loadState(doc["State"]["TransferFunction"]);
-		if (doc["State"]["TransferFunction"].HasMember("Colormap"))
+		getTransferFunction().loadState(state["TransferFunction"]);
+		if (state["TransferFunction"].HasMember("Colormap"))
 		{
-			getColorMap().loadState(doc["State"]["TransferFunction"]["Colormap"]);
+			getColorMap().loadState(state["TransferFunction"]["Colormap"]);
 			getColorMap().commit(getTransferFunction());
 		}
 		getTransferFunction().commit(getRenderer());
 	}
 
-	if (doc["State"].HasMember("Slices")) 
+	if (state.HasMember("Slices")) 
 	{
-		getSlices().loadState(doc["State"]["Slices"]);
+		getSlices().loadState(state["Slices"]);
 		getSlices().commit(getRenderer(), &volume);
 	}
 	
-	if (doc["State"].HasMember("Isosurfaces")) 
+	if (state.HasMember("Isosurfaces")) 
 	{
-		getIsos().loadState(doc["State"]["Isosurfaces"]);
+		getIsos().loadState(state["Isosurfaces"]);
 		getIsos().commit(&volume);
 	}
 
 	if (with_data)
-		LoadDataFromFile(doc["State"]["Volume"].GetString());
-	
-	in.close();
+		LoadDataFromFile(state["Volume"].GetString());
 }
 
 void
 Renderer::SaveState(std::string name)
 {
+	TraceScope trace(TRACE_STATE_FILE);
+
   Document doc;
   doc.Parse("{}");
 
@@ -183,10 +244,84 @@ Renderer::SaveState(std::string name)
 }
 
 
+// Tell the renderer which part of the image the volume, as clipped, can
+// reach; it leaves the tiles outside blank without tracing them
+
+void
+Renderer::UpdateCulling()
+{
+	int x, y, z, w, h;
+	volume.GetDimensions(x, y, z);
+	getWindow()->getSize(w, h);
+
+	float planes[12], bounds[4];
+	int k = slices.getClipPlanes(&volume, planes);
+	bool bounded = ScreenBounds(camera, x, y, z, planes, k, bounds);
+
+	if (bounded)
+	{
+		// A pixel of slack either way
+		bounds[0] -= 1.0 / w;  bounds[2] += 1.0 / w;
+		bounds[1] -= 1.0 / h;  bounds[3] += 1.0 / h;
+	}
+	else
+	{
+		bounds[0] = bounds[1] = 0;
+		bounds[2] = bounds[3] = 1;
+	}
+
+	CountCulledTiles(w, h, bounded, bounds);
+
+	if (culled && ! memcmp(bounds, cullBounds, sizeof(bounds)))
+		return;
+
+	ospSet2f(getRenderer(), "cull lower", bounds[0], bounds[1]);
+	ospSet2f(getRenderer(), "cull upper", bounds[2], bounds[3]);
+	memcpy(cullBounds, bounds, sizeof(bounds));
+	culled = true;
+
+	// Make sure the renderer picks them up
+	committedAt = -1;
+}
+
 void
 Renderer::Render(std::string fname) 
 { 
-	ospCommit(getRenderer());
-  getWindow()->render(getRenderer()); 
+	RenderFrame();
 	getWindow()->save(fname);
 }
+
+void
+Renderer::Render(PNGSink *sink)
+{
+	RenderFrame();
+	getWindow()->save(sink);
+}
+
+void
+Renderer::RenderFrame()
+{
+	if (lock) pthread_mutex_lock(lock);
+	volume.UpdateView(camera, true);
+
+	UpdateCulling();
+
+	// Nothing the renderer depends on has been committed since it was;
+	// the count is shared by all renderers, so this errs towards committing
+
+	if (committedAt != CommitsMade())
+	{
+		CountCommit(COMMIT_RENDERER, true);
+		TraceScope trace(TRACE_RENDERER_COMMIT);
+		ospCommit(getRenderer());
+		committedAt = CommitsMade();
+	}
+	else
+		CountCommit(COMMIT_RENDERER, false);
+
+	if (lock) pthread_mutex_unlock(lock);
+
+	volume.BeginRender();
+  getWindow()->render(getRenderer()); 
+	volume.EndRender();
+}
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <ospray/ospray.h>
+#include <pthread.h>
 #include <vector>
 
 #include "CinemaWindow.h"
+#include "PNGQueue.h"
 #include "Camera.h"
 #include "Lights.h"
 #include "TransferFunction.h"
@@ -21,6 +23,12 @@ class Renderer
 public:
 
 	Renderer(int, int);
+
+	// A second renderer for the data already loaded into master, with the
+	// same image size, encoder settings and initial state.  It renders
+	// master's voxels without copying them.
+	Renderer(Renderer& master);
+
 	~Renderer();
 
 	CinemaWindow 		 *getWindow() 					{return window;}
@@ -43,6 +51,10 @@ public:
 	// but will not munge camera state if it does
 	void LoadState(std::string, bool with_data);
 
+	// The same for the "State" member of a state document already parsed;
+	// members it doesn't have are left as they are
+	void ApplyState(Value& state, bool with_data);
+
 	// Use this to load a volume and set up a default camera
 	void LoadVolume(std::string);
 
@@ -52,9 +64,31 @@ public:
 	// Call this when you've set up shared volume data
 	void CommitVolume();
 
+	// Render from pyramid level l of the volume (0: full resolution), for
+	// quick preview sweeps.  Builds the levels it needs.
+	void SetLevel(int l);
+
 	void Render(std::string fname);
 
+	// Render and hand the encoded PNG to sink rather than writing a file
+	void Render(PNGSink *sink);
+
+	// Bring the OSPRay state up to date and render into the window, without
+	// saving the image
+	void RenderFrame();
+
+	// When several renderers run in separate threads, each holds this lock
+	// around its OSPRay object updates; only frames render concurrently
+	void SetLock(pthread_mutex_t *l) { lock = l; }
+
 private:
+	void Initialize(int, int);
+
+	// Hand the renderer the screen bounds of the volume for tile culling
+	void UpdateCulling();
+
+	// Default camera and commit everything, for a freshly loaded volume
+	void SetupDefaultView();
 
   // Use this to load a volume without changing other state (e.g. camera)
 	void LoadDataFromFile(std::string);
@@ -70,4 +104,17 @@ private:
 
 	OSPRenderer renderer;
 	Volume volume;
+
+	std::string stateFile;
+	pthread_mutex_t *lock;
+
+	// Pyramid level rendered
+	int level;
+
+	// CommitsMade() when the renderer was last committed
+	long committedAt;
+
+	// Culling bounds last given to the renderer, if any
+	bool culled;
+	float cullBounds[4];
 };
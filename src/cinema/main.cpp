@@ -20,6 +20,7 @@
 
 #include "Cinema.h"
 #include "cinema_cfg.h"
+#include "PNGQueue.h"
 
 using namespace std;
 
@@ -28,6 +29,11 @@ int main(int argc, char *argv[]) {
 		int ni = 32;
 		bool show = false;
 		bool saveState = false;
+		int encodeThreads = 2, encodeLevel = -1, encodeFilters = 0;
+		int lanes = 1;
+		float samplingRate = 0;
+		int preintegration = -1;
+		int level = 0;
 
 
   //! Initialize Cinema
@@ -46,6 +52,13 @@ int main(int argc, char *argv[]) {
     std::cerr << "    -F                          : save state files"		                           << std::endl;
     std::cerr << "    -s w h                      : size of images (1920x1080)"                    << std::endl;
     std::cerr << "    -n nImages                  : number of images to render (32)"               << std::endl;
+    std::cerr << "    -e nThreads                 : PNG encoder threads, 0 to encode inline (2)"   << std::endl;
+    std::cerr << "    -z level                    : PNG zlib compression level 0-9"                << std::endl;
+    std::cerr << "    -f filters                  : PNG filters, e.g. none or sub,up or all"       << std::endl;
+    std::cerr << "    -j nLanes                   : render this many images at once (1)"           << std::endl;
+    std::cerr << "    -r rate                     : volume samples per sampling step (1)"          << std::endl;
+    std::cerr << "    -p n                        : preintegrated transfer function, n x n, 0 off" << std::endl;
+    std::cerr << "    -L level                    : render from a coarser level of the volume (0)" << std::endl;
     std::cerr << " "                                                                               << std::endl;
     return(1);
   }
@@ -67,6 +80,42 @@ int main(int argc, char *argv[]) {
       if (i + 1 >= argc) throw std::runtime_error("missing number of images argument");
 			ni = atoi(argv[++i]);
 		}
+		else if (!strcmp(argv[i], "-e"))
+		{
+      if (i + 1 >= argc) throw std::runtime_error("missing number of encoder threads");
+			encodeThreads = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-z"))
+		{
+      if (i + 1 >= argc) throw std::runtime_error("missing compression level");
+			encodeLevel = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-f"))
+		{
+      if (i + 1 >= argc) throw std::runtime_error("missing PNG filters");
+			encodeFilters = PNGQueue::ParseFilters(argv[++i]);
+			if (encodeFilters < 0) throw std::runtime_error("unrecognized PNG filter");
+		}
+		else if (!strcmp(argv[i], "-j"))
+		{
+      if (i + 1 >= argc) throw std::runtime_error("missing number of lanes");
+			lanes = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-r"))
+		{
+      if (i + 1 >= argc) throw std::runtime_error("missing sampling rate");
+			samplingRate = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-p"))
+		{
+      if (i + 1 >= argc) throw std::runtime_error("missing preintegration table size");
+			preintegration = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-L"))
+		{
+      if (i + 1 >= argc) throw std::runtime_error("missing pyramid level");
+			level = atoi(argv[++i]);
+		}
 		else if (!strcmp(argv[i], "-F"))
     { saveState = true;
     }
@@ -84,8 +133,29 @@ int main(int argc, char *argv[]) {
   }
 
   Renderer renderer(w, h);
+	renderer.getWindow()->setEncoder(encodeThreads, encodeLevel, encodeFilters);
 	renderer.Load(std::string(filename));
 
+	// Fewer samples per step and a preintegrated transfer function trade
+	// quality for throughput
+
+	if (samplingRate > 0)
+	{
+		renderer.getVolume()->SetSamplingRate(samplingRate);
+		renderer.getVolume()->commit();
+	}
+
+	if (preintegration >= 0)
+	{
+		renderer.getTransferFunction().SetPreintegration(preintegration);
+		renderer.getTransferFunction().commit(renderer.getRenderer());
+	}
+
+	// A coarse level makes for a quick preview of a sweep
+
+	if (level > 0)
+		renderer.SetLevel(level);
+
 #if WITH_DISPLAY_WINDOW
 	renderer.getWindow()->setShow(show);
 #endif
@@ -162,8 +232,10 @@ int main(int argc, char *argv[]) {
 	camvar->ResetCount();
 
 	cinema.setSaveState(saveState);
+	cinema.setLanes(lanes);
 	cinema.Render(renderer, 0);
 	cinema.WriteInfo();
+	cinema.Report(renderer, std::cerr);
 
 	return(0);
 }
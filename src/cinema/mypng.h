@@ -1,2 +0,0 @@
-#pragma once
-int write_png(const char *filename, int w, int h, unsigned int *rgba);
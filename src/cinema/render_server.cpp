@@ -0,0 +1,716 @@
+// A long-running renderer.  Volumes stay loaded between requests, so
+// a client pays for ospInit, loading and setup once rather than per job.
+//
+// Clients connect to a Unix domain socket and send requests, one JSON
+// object per line, in the .state schema plus an id:
+//
+//		{"id": 7, "State": {"Volume": "head.vol", "Camera": {...}, ...}}
+//
+// Each volume has its own Renderer, whose state carries over from one
+// request to the next: members a request leaves out (Camera, Lights,
+// TransferFunction, Slices, Isosurfaces) keep the values the last request
+// against that volume gave them.  A request that names no Volume goes to
+// the one its connection used last.  "Level" selects a pyramid level, as
+// cinema_test -L does.  {"Command": "quit"} stops the server once the
+// requests before it are answered.
+//
+// Each request gets a reply line, in the order the connection sent them,
+//
+//		{"id": 7, "status": "ok", "width": 1920, "height": 1080, "bytes": n}
+//
+// followed by n bytes of PNG, or {"id": 7, "status": "error", "message":
+// "..."} with nothing after it.
+//
+// Requests are pipelined: everything that has arrived is taken in one
+// batch and rendered back to back, grouped by volume, while earlier
+// frames are encoded by the PNG encoder threads.  Sockets don't block:
+// replies queue on their connection and go out as it takes them, so a
+// client that stops reading holds up nobody else.
+
+#include <iostream>
+#include <list>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Renderer.h"
+#include "PNGQueue.h"
+
+using namespace std;
+
+// A connection.  Replies are finished by the encoder threads in any
+// order, queued in the order the requests came and sent as the socket
+// takes them.  Whoever queues a reply pokes wake so the poll loop looks
+// again at what each connection is waiting for.
+
+class Client
+{
+public:
+	Client(int f, int w) : fd(f), eof(false), wake(w), broken(false), nextSeq(0), nextSend(0), outstanding(0), sent(0)
+	{
+		pthread_mutex_init(&lock, NULL);
+	}
+
+	~Client()
+	{
+		close(fd);
+		pthread_mutex_destroy(&lock);
+	}
+
+	// A sequence number for the next request; it must be answered
+	int Expect()
+	{
+		pthread_mutex_lock(&lock);
+		outstanding++;
+		pthread_mutex_unlock(&lock);
+		return nextSeq++;
+	}
+
+	void Reply(int seq, std::string& msg)
+	{
+		pthread_mutex_lock(&lock);
+		done[seq].swap(msg);
+
+		std::map<int, std::string>::iterator i;
+		while ((i = done.find(nextSend)) != done.end())
+		{
+			if (! broken)
+				out.append(i->second);
+			done.erase(i);
+			nextSend++;
+			outstanding--;
+		}
+
+		flush();
+
+		// Once unlocked this may be deleted
+		int w = wake;
+		pthread_mutex_unlock(&lock);
+
+		char c = 0;
+		ssize_t n = write(w, &c, 1);
+		(void)n;
+	}
+
+	// Send as much of the queue as the socket will take
+	void Flush()
+	{
+		pthread_mutex_lock(&lock);
+		flush();
+		pthread_mutex_unlock(&lock);
+	}
+
+	// Replies queued and not yet sent
+	bool Sending()
+	{
+		pthread_mutex_lock(&lock);
+		bool s = sent < out.size();
+		pthread_mutex_unlock(&lock);
+		return s;
+	}
+
+	// Nothing more will come in and nothing more is owed
+	bool Finished()
+	{
+		pthread_mutex_lock(&lock);
+		bool f = (eof || broken) && outstanding == 0 && sent == out.size();
+		pthread_mutex_unlock(&lock);
+		return f;
+	}
+
+	int						fd;
+	std::string		in;				// bytes read that don't yet make a whole line
+	std::string		volume;		// last volume named
+	bool					eof;
+
+private:
+	void flush()
+	{
+		while (! broken && sent < out.size())
+		{
+			ssize_t n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				break;
+			if (n <= 0)
+				broken = true;
+			else
+				sent += n;
+		}
+
+		// Drop what's gone, a big piece at a time
+		if (broken || sent == out.size())
+		{
+			out.clear();
+			sent = 0;
+		}
+		else if (sent >= (1 << 20))
+		{
+			out.erase(0, sent);
+			sent = 0;
+		}
+	}
+
+	int												wake;
+	bool											broken;
+	int												nextSeq, nextSend, outstanding;
+	std::map<int, std::string>	done;
+	std::string								out;
+	size_t										sent;
+	pthread_mutex_t						lock;
+};
+
+static std::string
+ErrorReply(const std::string& id, const std::string& message)
+{
+	StringBuffer sbuf;
+	Writer<StringBuffer> writer(sbuf);
+	writer.String(message.c_str());
+
+	return std::string("{\"id\": ") + id + ", \"status\": \"error\", \"message\": " + sbuf.GetString() + "}\n";
+}
+
+// Sent on from whichever encoder thread finished the image
+
+class Reply : public PNGSink
+{
+public:
+	Reply(Client *c, int s, const std::string& i, int _w, int _h) : client(c), seq(s), id(i), w(_w), h(_h) {}
+
+	virtual void Encoded(bool ok, std::vector<unsigned char>& png)
+	{
+		std::string msg;
+
+		if (ok)
+		{
+			std::stringstream ss;
+			ss << "{\"id\": " << id << ", \"status\": \"ok\", \"width\": " << w << ", \"height\": " << h
+				 << ", \"bytes\": " << png.size() << "}\n";
+			msg = ss.str();
+			msg.append((const char *)&png[0], png.size());
+		}
+		else
+			msg = ErrorReply(id, "unable to encode image");
+
+		client->Reply(seq, msg);
+		delete this;
+	}
+
+private:
+	Client			*client;
+	int					seq;
+	std::string	id;
+	int					w, h;
+};
+
+struct Request
+{
+	Client			*client;
+	int					seq;
+	std::string	id;				// as JSON, to echo back
+	std::string	volume;
+	Document		*doc;
+};
+
+// A loaded volume and the renderer holding its state
+
+struct Resident
+{
+	Renderer		*renderer;
+	int					level;
+};
+
+class Server
+{
+public:
+	Server(int _w, int _h, int _maxResident) :
+		w(_w), h(_h), maxResident(_maxResident), encodeThreads(2), encodeLevel(-1), encodeFilters(0), quit(false) {}
+
+	~Server()
+	{
+		for (std::list<std::pair<std::string, Resident> >::iterator i = resident.begin(); i != resident.end(); i++)
+			delete i->second.renderer;
+	}
+
+	void SetEncoder(int threads, int level, int filters)
+	{
+		encodeThreads = threads; encodeLevel = level; encodeFilters = filters;
+	}
+
+	bool Listen(const char *path);
+	void Run();
+
+private:
+	void accept();
+	void drain();
+	void read(Client *c);
+	void take(Client *c, const std::string& line);
+	void process();
+	void render(Request& r);
+	Resident *find(const std::string& volume, std::string& error);
+
+	int w, h, maxResident;
+	int encodeThreads, encodeLevel, encodeFilters;
+
+	int listener;
+	int wake[2];			// replies queued, from any thread
+	std::string path;
+	std::vector<Client *> clients;
+	std::vector<Request> pending;
+
+	// Most recently used first
+	std::list<std::pair<std::string, Resident> > resident;
+
+	bool quit;
+};
+
+bool
+Server::Listen(const char *p)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if (strlen(p) >= sizeof(addr.sun_path))
+	{
+		std::cerr << "socket path too long: " << p << "\n";
+		return false;
+	}
+	strcpy(addr.sun_path, p);
+
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+	{
+		std::cerr << "unable to create socket: " << strerror(errno) << "\n";
+		return false;
+	}
+
+	unlink(p);
+	if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 || ::listen(listener, 16) < 0)
+	{
+		std::cerr << "unable to listen on " << p << ": " << strerror(errno) << "\n";
+		close(listener);
+		return false;
+	}
+
+	if (pipe(wake) < 0)
+	{
+		std::cerr << "unable to create pipe: " << strerror(errno) << "\n";
+		close(listener);
+		return false;
+	}
+	fcntl(wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(wake[1], F_SETFL, O_NONBLOCK);
+
+	path = p;
+	return true;
+}
+
+void
+Server::Run()
+{
+	while (! quit)
+	{
+		std::vector<struct pollfd> fds(2);
+		fds[0].fd = listener;
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		fds[1].fd = wake[0];
+		fds[1].events = POLLIN;
+		fds[1].revents = 0;
+
+		// Replies are queued on other threads too, and wake gets poked
+		// when they are, so this is rebuilt each time round
+
+		for (size_t i = 0; i < clients.size(); i++)
+		{
+			struct pollfd f;
+			f.fd = clients[i]->fd;
+			f.events = (clients[i]->eof ? 0 : POLLIN) | (clients[i]->Sending() ? POLLOUT : 0);
+			f.revents = 0;
+			if (! f.events)
+				f.fd = -1;
+			fds.push_back(f);
+		}
+
+		if (poll(&fds[0], fds.size(), -1) < 0 && errno != EINTR)
+		{
+			std::cerr << "poll failed: " << strerror(errno) << "\n";
+			break;
+		}
+
+		if (fds[1].revents & POLLIN)
+		{
+			char buf[256];
+			while (::read(wake[0], buf, sizeof(buf)) > 0)
+				;
+		}
+
+		for (size_t i = 0; i < clients.size(); i++)
+		{
+			short r = fds[i+2].revents;
+			if ((r & (POLLIN | POLLHUP | POLLERR)) && ! clients[i]->eof)
+				read(clients[i]);
+			if (r & (POLLOUT | POLLHUP | POLLERR))
+				clients[i]->Flush();
+		}
+
+		if (fds[0].revents & POLLIN)
+			accept();
+
+		process();
+
+		for (size_t i = 0; i < clients.size(); )
+			if (clients[i]->Finished())
+			{
+				delete clients[i];
+				clients.erase(clients.begin() + i);
+			}
+			else
+				i++;
+	}
+
+	// Answer what's been rendered before going
+
+	for (std::list<std::pair<std::string, Resident> >::iterator i = resident.begin(); i != resident.end(); i++)
+		i->second.renderer->getWindow()->finish();
+
+	drain();
+
+	for (size_t i = 0; i < clients.size(); i++)
+		delete clients[i];
+	clients.clear();
+
+	close(wake[0]);
+	close(wake[1]);
+	close(listener);
+	unlink(path.c_str());
+}
+
+// Send what's queued before going, giving up on connections that take
+// nothing for a while
+
+void
+Server::drain()
+{
+	for (;;)
+	{
+		std::vector<struct pollfd> fds;
+		std::vector<Client *> sending;
+		for (size_t i = 0; i < clients.size(); i++)
+			if (clients[i]->Sending())
+			{
+				struct pollfd f;
+				f.fd = clients[i]->fd;
+				f.events = POLLOUT;
+				f.revents = 0;
+				fds.push_back(f);
+				sending.push_back(clients[i]);
+			}
+
+		if (fds.empty())
+			break;
+
+		int n = poll(&fds[0], fds.size(), 5000);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			std::cerr << "dropping replies to " << fds.size() << " connection(s) that stopped reading\n";
+			break;
+		}
+
+		for (size_t i = 0; i < sending.size(); i++)
+			if (fds[i].revents)
+				sending[i]->Flush();
+	}
+}
+
+void
+Server::accept()
+{
+	int fd = ::accept(listener, NULL, NULL);
+	if (fd < 0)
+	{
+		std::cerr << "accept failed: " << strerror(errno) << "\n";
+		return;
+	}
+
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	clients.push_back(new Client(fd, wake[1]));
+}
+
+void
+Server::read(Client *c)
+{
+	char buf[65536];
+
+	for (;;)
+	{
+		ssize_t n = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (n <= 0)
+		{
+			c->eof = true;
+			break;
+		}
+		c->in.append(buf, n);
+	}
+
+	size_t b = 0, e;
+	while ((e = c->in.find('\n', b)) != std::string::npos)
+	{
+		if (e > b)
+			take(c, c->in.substr(b, e - b));
+		b = e + 1;
+	}
+	c->in.erase(0, b);
+
+	// A last request with no newline after it
+	if (c->eof && c->in.find_first_not_of(" \t\r") != std::string::npos)
+		take(c, c->in);
+	if (c->eof)
+		c->in.clear();
+}
+
+// Parse a request and queue it for the next batch
+
+void
+Server::take(Client *c, const std::string& line)
+{
+	Request r;
+	r.client = c;
+	r.seq = c->Expect();
+	r.id = "null";
+	r.doc = new Document;
+
+	r.doc->Parse(line.c_str());
+
+	if (! r.doc->IsObject())
+	{
+		std::string msg = ErrorReply(r.id, "request isn't a JSON object");
+		c->Reply(r.seq, msg);
+		delete r.doc;
+		return;
+	}
+
+	if (r.doc->HasMember("id"))
+	{
+		StringBuffer sbuf;
+		Writer<StringBuffer> writer(sbuf);
+		(*r.doc)["id"].Accept(writer);
+		r.id = sbuf.GetString();
+	}
+
+	if (r.doc->HasMember("State") && (*r.doc)["State"].IsObject() && (*r.doc)["State"].HasMember("Volume"))
+	{
+		if ((*r.doc)["State"]["Volume"].IsString())
+			c->volume = (*r.doc)["State"]["Volume"].GetString();
+	}
+
+	r.volume = c->volume;
+	pending.push_back(r);
+}
+
+// Render everything that has come in, a volume at a time, in the order
+// the volumes were first asked for
+
+void
+Server::process()
+{
+	std::vector<Request> batch;
+	batch.swap(pending);
+
+	std::vector<bool> handled(batch.size(), false);
+
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		if (handled[i])
+			continue;
+
+		for (size_t j = i; j < batch.size(); j++)
+			if (! handled[j] && batch[j].volume == batch[i].volume)
+			{
+				render(batch[j]);
+				delete batch[j].doc;
+				handled[j] = true;
+			}
+	}
+}
+
+void
+Server::render(Request& r)
+{
+	Document& doc = *r.doc;
+
+	if (doc.HasMember("Command"))
+	{
+		std::string msg;
+		if (doc["Command"].IsString() && std::string(doc["Command"].GetString()) == "quit")
+		{
+			quit = true;
+			msg = std::string("{\"id\": ") + r.id + ", \"status\": \"ok\"}\n";
+		}
+		else
+			msg = ErrorReply(r.id, "unknown command");
+
+		r.client->Reply(r.seq, msg);
+		return;
+	}
+
+	if (! doc.HasMember("State") || ! doc["State"].IsObject())
+	{
+		std::string msg = ErrorReply(r.id, "request has no State");
+		r.client->Reply(r.seq, msg);
+		return;
+	}
+
+	std::string error;
+	Resident *res = find(r.volume, error);
+	if (! res)
+	{
+		std::string msg = ErrorReply(r.id, error);
+		r.client->Reply(r.seq, msg);
+		return;
+	}
+
+	Renderer *renderer = res->renderer;
+	renderer->ApplyState(doc["State"], false);
+
+	int level = (doc.HasMember("Level") && doc["Level"].IsInt()) ? doc["Level"].GetInt() : 0;
+	if (level != res->level)
+	{
+		renderer->SetLevel(level);
+		res->level = level;
+	}
+
+	renderer->Render(new Reply(r.client, r.seq, r.id, w, h));
+}
+
+// The renderer for a volume, loading it if it isn't already and making
+// room for it if need be
+
+Resident *
+Server::find(const std::string& volume, std::string& error)
+{
+	if (volume == "")
+	{
+		error = "no Volume given";
+		return NULL;
+	}
+
+	for (std::list<std::pair<std::string, Resident> >::iterator i = resident.begin(); i != resident.end(); i++)
+		if (i->first == volume)
+		{
+			resident.splice(resident.begin(), resident, i);
+			return &resident.front().second;
+		}
+
+	// Volume::Import gives up on the whole process if it can't read the file
+	if (access(volume.c_str(), R_OK) != 0)
+	{
+		error = "can't read " + volume;
+		return NULL;
+	}
+
+	while (! resident.empty() && (int)resident.size() >= maxResident)
+	{
+		std::cerr << "unloading " << resident.back().first << "\n";
+		delete resident.back().second.renderer;
+		resident.pop_back();
+	}
+
+	std::cerr << "loading " << volume << "\n";
+
+	Resident res;
+	res.renderer = new Renderer(w, h);
+	res.renderer->getWindow()->setEncoder(encodeThreads, encodeLevel, encodeFilters);
+	res.renderer->LoadVolume(volume);
+	res.level = 0;
+
+	resident.push_front(std::make_pair(volume, res));
+	return &resident.front().second;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int w = 1920, h = 1080;
+	int maxResident = 4;
+	int encodeThreads = 2, encodeLevel = -1, encodeFilters = 0;
+	char *socketPath = NULL;
+
+	ospInit(&argc, (const char **)argv);
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-s") && i + 2 < argc)
+		{
+			w = atoi(argv[++i]);
+			h = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+			maxResident = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-e") && i + 1 < argc)
+			encodeThreads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-z") && i + 1 < argc)
+			encodeLevel = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+		{
+			encodeFilters = PNGQueue::ParseFilters(argv[++i]);
+			if (encodeFilters < 0)
+			{
+				std::cerr << "unrecognized PNG filter\n";
+				exit(1);
+			}
+		}
+		else if (argv[i][0] != '-' && socketPath == NULL)
+			socketPath = argv[i];
+		else
+		{
+			socketPath = NULL;
+			break;
+		}
+	}
+
+	if (! socketPath || maxResident < 1)
+	{
+		std::cerr << "usage: " << argv[0] << " [options] socket\n";
+		std::cerr << "options:\n";
+		std::cerr << "  -s w h        size of images (1920x1080)\n";
+		std::cerr << "  -m n          volumes kept loaded at once (4)\n";
+		std::cerr << "  -e nThreads   PNG encoder threads, 0 to encode inline (2)\n";
+		std::cerr << "  -z level      PNG zlib compression level 0-9\n";
+		std::cerr << "  -f filters    PNG filters, e.g. none or sub,up or all\n";
+		exit(1);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	Server server(w, h, maxResident);
+	server.SetEncoder(encodeThreads, encodeLevel, encodeFilters);
+
+	if (! server.Listen(socketPath))
+		exit(1);
+
+	std::cerr << "listening on " << socketPath << "\n";
+	server.Run();
+
+	return 0;
+}
@@ -0,0 +1,464 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <fstream>
+
+#include "AsyncWriter.h"
+#include "Timer.h"
+#include "Trace.h"
+#include "VoxelType.h"
+
+// O_DIRECT wants the buffer, the file offset and the length aligned to
+// the device's logical block; a page covers every device we'll meet
+
+#define ALIGNMENT 4096
+
+AsyncWriter::AsyncWriter(size_t c, int depth, bool d) :
+		chunkBytes(((c + ALIGNMENT - 1) / ALIGNMENT) * ALIGNMENT), direct(d),
+		busy(false), quit(false), current(-1), filled(0),
+		fd(-1), fdDirect(false), offset(0), fileFailed(false),
+		failed(false), writeTime(0), stallTime(0), written(0)
+{
+	if (chunkBytes == 0)
+		chunkBytes = ALIGNMENT;
+
+	for (int i = 0; i < (depth < 2 ? 2 : depth); i++)
+	{
+		void *p;
+		if (posix_memalign(&p, ALIGNMENT, chunkBytes))
+		{
+			std::cerr << "unable to allocate write buffers\n";
+			exit(1);
+		}
+		chunks.push_back((char *)p);
+		freeChunks.push_back(i);
+	}
+
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&work, NULL);
+	pthread_cond_init(&room, NULL);
+	pthread_cond_init(&done, NULL);
+
+	if (pthread_create(&thread, NULL, worker, (void *)this))
+	{
+		std::cerr << "unable to start writer thread\n";
+		exit(1);
+	}
+}
+
+AsyncWriter::~AsyncWriter()
+{
+	flush();
+
+	pthread_mutex_lock(&lock);
+	quit = true;
+	pthread_cond_broadcast(&work);
+	pthread_mutex_unlock(&lock);
+
+	pthread_join(thread, NULL);
+
+	for (size_t i = 0; i < chunks.size(); i++)
+		free(chunks[i]);
+
+	pthread_cond_destroy(&work);
+	pthread_cond_destroy(&room);
+	pthread_cond_destroy(&done);
+	pthread_mutex_destroy(&lock);
+}
+
+void *
+AsyncWriter::worker(void *p)
+{
+	((AsyncWriter *)p)->run();
+	return NULL;
+}
+
+void
+AsyncWriter::run()
+{
+	pthread_mutex_lock(&lock);
+
+	while (true)
+	{
+		while (ops.empty() && ! quit)
+			pthread_cond_wait(&work, &lock);
+
+		if (ops.empty())
+			break;
+
+		Op op = ops.front();
+		ops.pop_front();
+		busy = true;
+
+		// Begin may grow members while this one is being worked on
+		Member m;
+		if (op.member >= 0)
+			m = members[op.member];
+
+		pthread_mutex_unlock(&lock);
+
+		double t0 = WallClock();
+
+		if (op.kind == OPEN)
+			openFile(m);
+		else if (op.kind == DATA)
+			writeChunk(chunks[op.chunk], op.bytes);
+		else
+			closeFile(m);
+
+		double t1 = WallClock();
+
+		pthread_mutex_lock(&lock);
+		busy = false;
+		failed = failed || fileFailed;
+		writeTime += t1 - t0;
+		if (op.kind == DATA)
+		{
+			written += op.bytes;
+			freeChunks.push_back(op.chunk);
+			pthread_cond_signal(&room);
+		}
+		if (ops.empty())
+			pthread_cond_broadcast(&done);
+	}
+
+	pthread_mutex_unlock(&lock);
+}
+
+void
+AsyncWriter::queue(Op& op)
+{
+	pthread_mutex_lock(&lock);
+	ops.push_back(op);
+	pthread_cond_signal(&work);
+	pthread_mutex_unlock(&lock);
+}
+
+// A free chunk, waiting for the writer if there isn't one
+
+int
+AsyncWriter::freeChunk()
+{
+	double t0 = WallClock();
+
+	pthread_mutex_lock(&lock);
+	while (freeChunks.empty())
+		pthread_cond_wait(&room, &lock);
+
+	int c = freeChunks.back();
+	freeChunks.pop_back();
+	stallTime += WallClock() - t0;
+	pthread_mutex_unlock(&lock);
+
+	return c;
+}
+
+// False once anything has failed to write.  failed is set by the writer
+// thread, so it's only looked at under the lock.
+
+bool
+AsyncWriter::ok()
+{
+	pthread_mutex_lock(&lock);
+	bool f = failed;
+	pthread_mutex_unlock(&lock);
+	return ! f;
+}
+
+void
+AsyncWriter::flush()
+{
+	pthread_mutex_lock(&lock);
+	while (ops.size() || busy)
+		pthread_cond_wait(&done, &lock);
+	pthread_mutex_unlock(&lock);
+}
+
+bool
+AsyncWriter::Begin(const std::string& raw, int x, int y, int z, const std::string& type)
+{
+	if (current != -1)
+		End();
+
+	Member m;
+	m.raw = raw;
+	m.x = x; m.y = y; m.z = z;
+	m.type = type;
+
+	pthread_mutex_lock(&lock);
+	members.push_back(m);
+	int i = members.size() - 1;
+	pthread_mutex_unlock(&lock);
+
+	Op op;
+	op.kind = OPEN;
+	op.member = i;
+	op.chunk = -1;
+	op.bytes = 0;
+	queue(op);
+
+	current = freeChunk();
+	filled = 0;
+
+	return ok();
+}
+
+bool
+AsyncWriter::Write(const void *data, size_t bytes)
+{
+	if (current == -1)
+	{
+		std::cerr << "AsyncWriter::Write outside Begin/End\n";
+		return false;
+	}
+
+	const char *src = (const char *)data;
+	while (bytes)
+	{
+		size_t n = chunkBytes - filled;
+		if (n > bytes)
+			n = bytes;
+
+		memcpy(chunks[current] + filled, src, n);
+		filled += n;
+		src += n;
+		bytes -= n;
+
+		if (filled == chunkBytes)
+		{
+			Op op;
+			op.kind = DATA;
+			op.member = -1;
+			op.chunk = current;
+			op.bytes = filled;
+			queue(op);
+
+			current = freeChunk();
+			filled = 0;
+		}
+	}
+
+	return ok();
+}
+
+void
+AsyncWriter::End()
+{
+	if (current == -1)
+		return;
+
+	Op op;
+	op.kind = DATA;
+	op.member = -1;
+	op.chunk = current;
+	op.bytes = filled;
+
+	if (filled)
+		queue(op);
+	else
+	{
+		pthread_mutex_lock(&lock);
+		freeChunks.push_back(current);
+		pthread_mutex_unlock(&lock);
+	}
+
+	current = -1;
+	filled = 0;
+
+	pthread_mutex_lock(&lock);
+	op.kind = CLOSE;
+	op.member = members.size() - 1;
+	op.chunk = -1;
+	op.bytes = 0;
+	pthread_mutex_unlock(&lock);
+	queue(op);
+}
+
+bool
+AsyncWriter::Finish(const std::string& ser)
+{
+	End();
+	flush();
+
+	// Members are named relative to the .ser where they're under its
+	// directory; VolumeSeries::Import takes names from there
+
+	size_t slash = ser.rfind('/');
+	std::string dir = slash == std::string::npos ? "" : ser.substr(0, slash + 1);
+
+	std::ofstream s(ser.c_str());
+	s << members.size() << "\n";
+	for (size_t i = 0; i < members.size(); i++)
+	{
+		std::string vol = members[i].raw.substr(0, members[i].raw.rfind('.')) + ".vol";
+		if (dir.size() && vol.compare(0, dir.size(), dir) == 0)
+			vol = vol.substr(dir.size());
+		s << vol << "\n";
+	}
+	s.close();
+
+	if (s.fail())
+	{
+		std::cerr << "unable to write " << ser << "\n";
+		pthread_mutex_lock(&lock);
+		failed = true;
+		pthread_mutex_unlock(&lock);
+	}
+
+	return ok();
+}
+
+void
+AsyncWriter::Report(std::ostream& o)
+{
+	pthread_mutex_lock(&lock);
+	o << "writer: " << members.size() << " files, " << written / (1024.0*1024.0) << " MB"
+		<< (direct ? " (direct)" : "") << "\n";
+	o << "  write:   " << writeTime << " s";
+	if (writeTime > 0)
+		o << ", " << written / (1024.0*1024.0) / writeTime << " MB/s";
+	o << "\n";
+	o << "  stalled: " << stallTime << " s waiting for the disk\n";
+	pthread_mutex_unlock(&lock);
+}
+
+// The rest runs on the writer thread
+
+void
+AsyncWriter::openFile(Member& m)
+{
+	offset = 0;
+	fileFailed = false;
+	fdDirect = false;
+	fd = -1;
+
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+#ifdef O_DIRECT
+	if (direct)
+	{
+		fd = ::open(m.raw.c_str(), flags | O_DIRECT, 0644);
+		fdDirect = fd >= 0;
+	}
+#endif
+
+	if (fd < 0)
+		fd = ::open(m.raw.c_str(), flags, 0644);
+
+	if (fd < 0)
+	{
+		std::cerr << "unable to create " << m.raw << "\n";
+		fileFailed = true;
+		return;
+	}
+
+	bool uncached = fdDirect;
+
+#ifdef F_NOCACHE
+	if (direct)
+		uncached = fcntl(fd, F_NOCACHE, 1) == 0;
+#endif
+
+	static bool warned = false;
+	if (direct && ! uncached && ! warned)
+	{
+		std::cerr << "direct I/O unavailable for " << m.raw << ", writing through the page cache\n";
+		warned = true;
+	}
+}
+
+void
+AsyncWriter::writeChunk(char *data, size_t bytes)
+{
+	if (fileFailed)
+		return;
+
+	TraceScope trace(TRACE_SIM_DUMP);
+
+	// Only a file's last chunk can be short; O_DIRECT writes it padded
+	// out to a block, and the file is cut back to size on close
+
+	size_t n = bytes;
+	if (fdDirect && n % ALIGNMENT)
+	{
+		size_t padded = ((n + ALIGNMENT - 1) / ALIGNMENT) * ALIGNMENT;
+		memset(data + n, 0, padded - n);
+		n = padded;
+	}
+
+	size_t done = 0;
+	while (done < n)
+	{
+		ssize_t k = pwrite(fd, data + done, n - done, offset + done);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0)
+		{
+			std::cerr << "error writing: " << strerror(errno) << "\n";
+			fileFailed = true;
+			return;
+		}
+		done += k;
+	}
+
+#ifdef SYNC_FILE_RANGE_WRITE
+	// Start this chunk on its way to disk, then wait for the one before
+	// and let the page cache drop it
+
+	if (! fdDirect)
+	{
+		sync_file_range(fd, offset, n, SYNC_FILE_RANGE_WRITE);
+		if (offset >= chunkBytes)
+		{
+			off_t prev = offset - chunkBytes;
+			sync_file_range(fd, prev, chunkBytes,
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+			posix_fadvise(fd, prev, chunkBytes, POSIX_FADV_DONTNEED);
+		}
+	}
+#endif
+
+	offset += bytes;
+}
+
+void
+AsyncWriter::closeFile(Member& m)
+{
+	if (fd < 0)
+		return;
+
+	if (fdDirect && ! fileFailed && ftruncate(fd, offset))
+	{
+		std::cerr << "unable to trim " << m.raw << "\n";
+		fileFailed = true;
+	}
+
+	if (::close(fd))
+		fileFailed = true;
+	fd = -1;
+
+	if (fileFailed)
+		return;
+
+	size_t expected = ((size_t)m.x) * m.y * m.z * VoxelSize(m.type);
+	if (offset != expected)
+		std::cerr << m.raw << ": wrote " << offset << " bytes, expected " << expected << "\n";
+
+	// The .vol names the raw file relative to itself
+
+	std::string vol = m.raw.substr(0, m.raw.rfind('.')) + ".vol";
+	size_t slash = m.raw.rfind('/');
+
+	std::ofstream v(vol.c_str());
+	v << m.x << " " << m.y << " " << m.z << " " << m.type << " "
+		<< (slash == std::string::npos ? m.raw : m.raw.substr(slash + 1)) << "\n";
+	v.close();
+
+	if (v.fail())
+	{
+		std::cerr << "unable to write " << vol << "\n";
+		fileFailed = true;
+	}
+}
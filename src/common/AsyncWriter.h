@@ -0,0 +1,111 @@
+#pragma once
+
+#include <pthread.h>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Writes a volume series as raw files on a background thread, so the
+// producer can get on with the next slab or time step while the last
+// one goes to disk.  Data passes through a fixed pool of page aligned
+// chunks; when all of them are queued the producer waits, which bounds
+// the memory held and paces it to the disk rather than to the page
+// cache.  Every queued chunk but the last of a file is full.
+//
+// With direct set files are written with O_DIRECT (F_NOCACHE on macOS),
+// falling back to buffered writes where the file system won't have it.
+// Buffered writes start writeback of each chunk as soon as it's written
+// and drop the one before from the page cache once it's on disk, so
+// dirty pages don't pile up behind a long series.
+//
+// Each member gets a .vol beside its .raw, and Finish writes a .ser
+// listing them in order that VolumeSeries::Import reads.  Begin, Write,
+// End and Finish are for one producer thread.
+
+class AsyncWriter
+{
+public:
+		AsyncWriter(size_t chunkBytes = 8 << 20, int depth = 4, bool direct = false);
+		~AsyncWriter();
+
+		// Start a member of the series: raw is the file the voxels go to,
+		// and its .vol is written when it's done.  Files are opened and
+		// written on the writer thread, so this and Write return false
+		// once anything queued earlier has failed.
+
+		bool Begin(const std::string& raw, int x, int y, int z, const std::string& type);
+
+		// Append to the current member; data is copied, so the caller can
+		// reuse it as soon as this returns
+
+		bool Write(const void *data, size_t bytes);
+
+		// Queue the end of the current member without waiting for it
+
+		void End();
+
+		// Wait for everything queued to be written and write the .ser.
+		// Returns false if anything failed to write.
+
+		bool Finish(const std::string& ser);
+
+		void Report(std::ostream& o);
+
+private:
+		enum { OPEN, DATA, CLOSE };
+
+		struct Op
+		{
+			int			kind;
+			int			member;
+			int			chunk;
+			size_t	bytes;
+		};
+
+		struct Member
+		{
+			std::string	raw;
+			int					x, y, z;
+			std::string	type;
+		};
+
+		static void *worker(void *);
+		void run();
+		void queue(Op& op);
+		void flush();
+		bool ok();
+		int  freeChunk();
+
+		void openFile(Member& m);
+		void writeChunk(char *data, size_t bytes);
+		void closeFile(Member& m);
+
+		size_t							chunkBytes;
+		bool								direct;
+
+		std::vector<char *>	chunks;
+		std::vector<int>		freeChunks;
+		std::deque<Op>			ops;
+		std::vector<Member>	members;
+		bool								busy, quit;
+
+		// The producer's partly filled chunk
+		int									current;
+		size_t							filled;
+
+		// Writer thread's file
+		int									fd;
+		bool								fdDirect;
+		size_t							offset;
+		bool								fileFailed;
+
+		// Something failed; under the lock
+		bool								failed;
+		double							writeTime, stallTime;
+		size_t							written;
+
+		pthread_t						thread;
+		pthread_mutex_t			lock;
+		pthread_cond_t			work, room, done;
+};
@@ -0,0 +1,423 @@
+#include <iostream>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "BrickCache.h"
+#include "Parallel.h"
+
+static void
+release_pages(char *p, size_t n)
+{
+	static size_t pg = sysconf(_SC_PAGESIZE);
+
+	// Only pages entirely inside [p, p+n) belong to this brick alone
+
+	uintptr_t s = ((uintptr_t)p + pg - 1) & ~(pg - 1);
+	uintptr_t e = ((uintptr_t)p + n) & ~(pg - 1);
+	if (e > s)
+		madvise((void *)s, e - s, MADV_DONTNEED);
+}
+
+static bool
+box_outside(const int lo[3], const int hi[3], const float planes[][4], int nplanes, float slack)
+{
+	for (int i = 0; i < nplanes; i++)
+	{
+		const float *p = planes[i];
+		float v = p[3] + slack;
+		for (int k = 0; k < 3; k++)
+			v += p[k] * (p[k] > 0 ? hi[k] : lo[k]);
+		if (v < 0)
+			return true;
+	}
+	return false;
+}
+
+struct BrickDistance
+{
+	int   brick;
+	float d;
+	bool operator<(const BrickDistance& o) const { return d < o.d; }
+};
+
+BrickCache::BrickCache(BrickFile *f, size_t _budget) :
+		file(f), budget(_budget), resident(0), next(0), generation(0),
+		busy(false), quit(false), warned(false),
+		nLoads(0), nEvictions(0), nBytesRead(0)
+{
+	file->GetDimensions(x, y, z);
+	vsz = file->GetVoxelSize();
+
+	int n = file->GetNumberOfBricks();
+	state.resize(n, ABSENT);
+	stamp.resize(n, 0);
+	visible.resize(n, 0);
+
+	size_t biggest = 0;
+	for (int b = 0; b < n; b++)
+		if (file->GetBrickBytes(b) > biggest)
+			biggest = file->GetBrickBytes(b);
+
+	if (budget < biggest)
+	{
+		std::cerr << "brick cache budget raised to one brick (" << biggest << " bytes)\n";
+		budget = biggest;
+	}
+
+	// Address space only; untouched pages read as zero and cost nothing
+
+	baseSize = ((size_t)x)*y*z*vsz;
+	base = (char *)mmap(NULL, baseSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED)
+	{
+		std::cerr << "unable to reserve " << baseSize << " bytes for brick cache\n";
+		exit(1);
+	}
+
+	int bx, by, bz;
+	file->GetBrickSize(bx, by, bz);
+	if (bx < x)
+		std::cerr << "bricks don't span the volume in x; evicted bricks will only partly release memory\n";
+
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&work, NULL);
+	pthread_cond_init(&done, NULL);
+	pthread_rwlock_init(&voxelLock, NULL);
+	pthread_create(&thread, NULL, prefetcher, (void *)this);
+}
+
+BrickCache::~BrickCache()
+{
+	pthread_mutex_lock(&lock);
+	quit = true;
+	pthread_cond_signal(&work);
+	pthread_mutex_unlock(&lock);
+
+	pthread_join(thread, NULL);
+
+	pthread_cond_destroy(&work);
+	pthread_cond_destroy(&done);
+	pthread_mutex_destroy(&lock);
+	pthread_rwlock_destroy(&voxelLock);
+
+	munmap(base, baseSize);
+}
+
+void
+BrickCache::SetView(const float eye[3], const float planes[][4], int nplanes)
+{
+	// Interactive callers pass the same view on every repaint; don't
+	// restart the queue for those
+
+	std::vector<float> view(eye, eye + 3);
+	for (int i = 0; i < nplanes; i++)
+		view.insert(view.end(), planes[i], planes[i] + 4);
+
+	if (view == lastView)
+		return;
+	lastView = view;
+
+	int bx, by, bz;
+	file->GetBrickSize(bx, by, bz);
+
+	// Bricks within one brick diagonal of the frustum are prefetched
+	// once the visible ones are in
+
+	float slack = sqrtf((float)(bx*bx + by*by + bz*bz));
+
+	std::vector<BrickDistance> inside, near;
+
+	for (int b = 0; b < file->GetNumberOfBricks(); b++)
+	{
+		int lo[3], hi[3];
+		file->GetBrickBox(b, lo, hi);
+
+		BrickDistance bd;
+		bd.brick = b;
+		bd.d = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			float c = 0.5*(lo[k] + hi[k]) - eye[k];
+			bd.d += c*c;
+		}
+
+		if (! box_outside(lo, hi, planes, nplanes, 0))
+			inside.push_back(bd);
+		else if (! box_outside(lo, hi, planes, nplanes, slack))
+			near.push_back(bd);
+	}
+
+	std::sort(inside.begin(), inside.end());
+	std::sort(near.begin(), near.end());
+
+	pthread_mutex_lock(&lock);
+
+	generation++;
+
+	std::fill(visible.begin(), visible.end(), 0);
+	queue.clear();
+	for (size_t i = 0; i < inside.size(); i++)
+	{
+		visible[inside[i].brick] = 1;
+		stamp[inside[i].brick] = generation;
+		queue.push_back(inside[i].brick);
+	}
+	for (size_t i = 0; i < near.size(); i++)
+		queue.push_back(near[i].brick);
+
+	next = 0;
+
+	pthread_cond_signal(&work);
+	pthread_mutex_unlock(&lock);
+}
+
+bool
+BrickCache::Idle()
+{
+	pthread_mutex_lock(&lock);
+	bool idle = ! busy && next >= queue.size();
+	pthread_mutex_unlock(&lock);
+	return idle;
+}
+
+bool
+BrickCache::Wait()
+{
+	pthread_mutex_lock(&lock);
+
+	while (busy || next < queue.size())
+		pthread_cond_wait(&done, &lock);
+
+	bool all = true;
+	for (size_t b = 0; all && b < visible.size(); b++)
+		if (visible[b] && state[b] != RESIDENT)
+			all = false;
+
+	pthread_mutex_unlock(&lock);
+	return all;
+}
+
+void
+BrickCache::GetStats(size_t& loads, size_t& evictions, size_t& bytesRead)
+{
+	pthread_mutex_lock(&lock);
+	loads = nLoads;
+	evictions = nEvictions;
+	bytesRead = nBytesRead;
+	pthread_mutex_unlock(&lock);
+}
+
+void *
+BrickCache::prefetcher(void *p)
+{
+	((BrickCache *)p)->run();
+	return NULL;
+}
+
+// Called with the lock held.  Visible bricks may push out anything
+// that isn't visible; prefetches only push out bricks that weren't used
+// by the current view.
+
+bool
+BrickCache::makeRoom(int b, size_t sz)
+{
+	bool forVisible = visible[b];
+
+	while (resident + sz > budget)
+	{
+		int victim = -1;
+		for (size_t i = 0; i < state.size(); i++)
+			if (state[i] == RESIDENT && ! visible[i] && (victim < 0 || stamp[i] < stamp[victim]))
+				victim = i;
+
+		if (victim < 0 || (! forVisible && stamp[victim] == generation))
+			return false;
+
+		evict(victim);
+	}
+
+	return true;
+}
+
+// Called with the lock held.  The brick's pages are released later, by
+// release, once no frame is reading them.
+
+void
+BrickCache::evict(int b)
+{
+	state[b] = ABSENT;
+	resident -= file->GetBrickBytes(b);
+	nEvictions++;
+	evicted.push_back(b);
+}
+
+// Called with the voxel lock held for writing
+
+void
+BrickCache::release(int b)
+{
+	int lo[3], hi[3];
+	file->GetBrickBox(b, lo, hi);
+
+	if (lo[0] == 0 && hi[0] == x)
+	{
+		size_t plane = ((size_t)(hi[1] - lo[1]))*x*vsz;
+		for (int k = lo[2]; k < hi[2]; k++)
+			release_pages(base + (((size_t)k)*y + lo[1])*x*vsz, plane);
+	}
+	else
+	{
+		size_t row = (hi[0] - lo[0])*vsz;
+		for (int k = lo[2]; k < hi[2]; k++)
+			for (int j = lo[1]; j < hi[1]; j++)
+				release_pages(base + ((((size_t)k)*y + j)*x + lo[0])*vsz, row);
+	}
+}
+
+// Called without the lock: reads and decodes a brick into buf, which
+// belongs to this brick of the batch alone
+
+bool
+BrickCache::load(int b, std::vector<char>& buf)
+{
+	size_t sz = file->GetBrickBytes(b);
+	if (buf.size() < sz)
+		buf.resize(sz);
+
+	return file->ReadBrick(b, &buf[0]);
+}
+
+// Called with the voxel lock held for writing
+
+void
+BrickCache::place(int b, const std::vector<char>& buf)
+{
+	int lo[3], hi[3];
+	file->GetBrickBox(b, lo, hi);
+
+	const char *src = &buf[0];
+	size_t row = (hi[0] - lo[0])*vsz;
+	for (int k = lo[2]; k < hi[2]; k++)
+		for (int j = lo[1]; j < hi[1]; j++, src += row)
+			memcpy(base + ((((size_t)k)*y + j)*x + lo[0])*vsz, src, row);
+}
+
+class BrickLoadTask : public ParallelTask
+{
+public:
+	BrickLoadTask(BrickCache *c) : cache(c) {}
+
+	void run(int i, int count)
+	{
+		ok[i] = cache->load(bricks[i], cache->scratch[i]);
+	}
+
+	BrickCache				*cache;
+	std::vector<int>	bricks;
+	std::vector<char>	ok;
+};
+
+void
+BrickCache::run()
+{
+	// Compressed bricks cost CPU to decode, so a batch of them is
+	// loaded in parallel; raw bricks are read one at a time
+
+	int batch = file->GetCodec() == BRICK_RAW ? 1 : ParallelThreadCount();
+	scratch.resize(batch);
+
+	BrickLoadTask task(this);
+
+	pthread_mutex_lock(&lock);
+
+	while (! quit)
+	{
+		if (next >= queue.size())
+		{
+			busy = false;
+			pthread_cond_broadcast(&done);
+			pthread_cond_wait(&work, &lock);
+			continue;
+		}
+
+		busy = true;
+
+		// Claim the space for the batch before dropping the lock
+
+		task.bricks.clear();
+		while ((int)task.bricks.size() < batch && next < queue.size())
+		{
+			int b = queue[next++];
+			if (state[b] == RESIDENT)
+				continue;
+
+			size_t sz = file->GetBrickBytes(b);
+			if (! makeRoom(b, sz))
+			{
+				if (visible[b] && ! warned)
+				{
+					std::cerr << "brick cache budget is smaller than the visible bricks\n";
+					warned = true;
+				}
+
+				next = queue.size();
+				break;
+			}
+
+			resident += sz;
+			task.bricks.push_back(b);
+		}
+
+		int n = task.bricks.size();
+		if (! n && evicted.empty())
+			continue;
+
+		task.ok.assign(n, 0);
+		uint64_t g = generation;
+
+		std::vector<int> gone;
+		gone.swap(evicted);
+
+		pthread_mutex_unlock(&lock);
+
+		if (n == 1)
+			task.run(0, 1);
+		else if (n > 1)
+			ParallelRun(task, n);
+
+		// Hand the batch over between frames.  Releases go first: a brick
+		// evicted while claiming the batch may be in it again.
+
+		pthread_rwlock_wrlock(&voxelLock);
+		for (size_t i = 0; i < gone.size(); i++)
+			release(gone[i]);
+		for (int i = 0; i < n; i++)
+			if (task.ok[i])
+				place(task.bricks[i], scratch[i]);
+		pthread_rwlock_unlock(&voxelLock);
+
+		pthread_mutex_lock(&lock);
+
+		for (int i = 0; i < n; i++)
+		{
+			int b = task.bricks[i];
+			if (task.ok[i])
+			{
+				state[b] = RESIDENT;
+				if (stamp[b] < g) stamp[b] = g;
+				nLoads++;
+				nBytesRead += file->GetStoredBytes(b);
+			}
+			else
+				resident -= file->GetBrickBytes(b);
+		}
+	}
+
+	busy = false;
+	pthread_cond_broadcast(&done);
+	pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+
+#include "BrickFile.h"
+
+// Pages the bricks of a BrickFile into a linear (x-fastest) voxel
+// buffer that can be handed to a shared_structured_volume.  The buffer
+// is a reservation of address space only: voxels of bricks that are not
+// resident read as zero, and evicting a brick hands its pages back to
+// the kernel.  Resident bricks are kept under a memory budget with LRU
+// replacement.
+//
+// A prefetcher thread loads bricks in the order given by the last view
+// passed to SetView: bricks intersecting the view frustum nearest the
+// eye first, then bricks just outside it so that small camera moves
+// find their data already resident.
+//
+// Bricks are read and decoded off to the side and only copied into the
+// buffer, or released from it, while nobody is rendering from it:
+// renderers bracket each frame with BeginRead and EndRead.
+
+class BrickCache
+{
+public:
+		BrickCache(BrickFile *f, size_t budget);
+		~BrickCache();
+
+		void *GetVoxels() { return base; }
+
+		// Frustum planes as (nx, ny, nz, d), inside where n.p + d >= 0,
+		// in voxel coordinates.  Replaces any pending prefetch work.
+
+		void SetView(const float eye[3], const float planes[][4], int nplanes);
+
+		// Block until the prefetcher has done what it can for the
+		// current view.  Returns true if every visible brick is resident.
+
+		bool Wait();
+
+		// True if the prefetcher has nothing left to do for the current view
+
+		bool Idle();
+
+		// Hold off changes to the voxel buffer while a frame is rendered
+
+		void BeginRead() { pthread_rwlock_rdlock(&voxelLock); }
+		void EndRead() { pthread_rwlock_unlock(&voxelLock); }
+
+		size_t GetResidentBytes() { return resident; }
+		// bytesRead counts bytes read from the file, before decoding
+
+		void GetStats(size_t& loads, size_t& evictions, size_t& bytesRead);
+
+private:
+		static void *prefetcher(void *);
+		void run();
+
+		friend class BrickLoadTask;
+		bool load(int b, std::vector<char>& buf);
+		void place(int b, const std::vector<char>& buf);
+		void release(int b);
+		void evict(int b);
+		bool makeRoom(int b, size_t sz);
+
+		enum { ABSENT, RESIDENT };
+
+		BrickFile						*file;
+		int 								x, y, z, vsz;
+		char 								*base;
+		size_t 							baseSize;
+		size_t							budget, resident;
+
+		std::vector<char>		state;
+		std::vector<uint64_t> stamp;			// view generation of last use
+		std::vector<char>		visible;		// in the current frustum
+
+		std::vector<int>		queue;			// bricks to load, in priority order
+		std::vector<int>		evicted;		// bricks whose pages are still to go
+		size_t							next;
+		uint64_t						generation;
+		bool								busy, quit, warned;
+
+		size_t							nLoads, nEvictions, nBytesRead;
+		std::vector< std::vector<char> > scratch;		// one per brick of a batch
+		std::vector<float>	lastView;
+
+		pthread_t 					thread;
+		pthread_mutex_t 		lock;
+		pthread_cond_t			work, done;
+		pthread_rwlock_t		voxelLock;
+};
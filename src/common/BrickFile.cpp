@@ -0,0 +1,571 @@
+#include <iostream>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <zlib.h>
+
+#include "BrickFile.h"
+#include "Macrocells.h"
+#include "Parallel.h"
+#include "VoxelType.h"
+
+// Bricks are paged straight into the OSPRay volume, so only types it can
+// sample are allowed
+
+static int
+type_size(const std::string& type)
+{
+	return VoxelTypeNative(type) ? VoxelSize(type) : 0;
+}
+
+static int
+quantized_bits(int codec)
+{
+	return codec == BRICK_Q16 ? 16 : codec == BRICK_Q8 ? 8 : 0;
+}
+
+template<typename T>
+static void
+range(const T *v, size_t n, float& m, float& M)
+{
+	T lo = v[0], hi = v[0];
+	for (size_t i = 1; i < n; i++)
+	{
+		lo = v[i] < lo ? v[i] : lo;
+		hi = v[i] > hi ? v[i] : hi;
+	}
+	m = (float)lo;
+	M = (float)hi;
+}
+
+static void
+brick_range(const void *v, size_t n, const std::string& type, float& m, float& M)
+{
+	if (type == "float")
+		range((const float *)v, n, m, M);
+	else if (type == "uchar")
+		range((const unsigned char *)v, n, m, M);
+	else if (type == "ushort")
+		range((const unsigned short *)v, n, m, M);
+	else
+		range((const short *)v, n, m, M);
+}
+
+// Steps are spread evenly over [m, M]; NaNs quantize to m
+
+static void
+quantize(const float *v, size_t n, float m, float M, int bits, void *dst)
+{
+	float steps = (float)((1 << bits) - 1);
+	float s = M > m ? steps / (M - m) : 0.0f;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		float q = (v[i] - m) * s + 0.5f;
+		q = q >= 0.0f ? (q <= steps ? q : steps) : 0.0f;
+		if (bits == 16)
+			((uint16_t *)dst)[i] = (uint16_t)q;
+		else
+			((uint8_t *)dst)[i] = (uint8_t)q;
+	}
+}
+
+static void
+dequantize(const void *src, size_t n, float m, float M, int bits, float *dst)
+{
+	float s = (M - m) / (float)((1 << bits) - 1);
+
+	if (bits == 16)
+		for (size_t i = 0; i < n; i++)
+			dst[i] = m + ((const uint16_t *)src)[i] * s;
+	else
+		for (size_t i = 0; i < n; i++)
+			dst[i] = m + ((const uint8_t *)src)[i] * s;
+}
+
+BrickFile::BrickFile() : fd(-1), nbx(0), nby(0), nbz(0)
+{
+	memset(&header, 0, sizeof(header));
+}
+
+BrickFile::~BrickFile()
+{
+	Close();
+}
+
+void
+BrickFile::Close()
+{
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+}
+
+int
+BrickFile::CodecFromName(const std::string& name)
+{
+	for (int c = BRICK_RAW; c <= BRICK_Q8; c++)
+		if (name == CodecName(c))
+			return c;
+	return -1;
+}
+
+const char *
+BrickFile::CodecName(int codec)
+{
+	switch (codec)
+	{
+		case BRICK_RAW:		return "raw";
+		case BRICK_ZLIB:	return "zlib";
+		case BRICK_Q16:		return "q16";
+		case BRICK_Q8:		return "q8";
+		default:					return NULL;
+	}
+}
+
+bool
+BrickFile::Open(const std::string& name)
+{
+	Close();
+
+	fd = open(name.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		std::cerr << "can't open brick file " << name << "\n";
+		return false;
+	}
+
+	if (pread(fd, &header, sizeof(header), 0) < (ssize_t)offsetof(BrickFileHeader, codec) ||
+			strncmp(header.magic, BRICKFILE_MAGIC, 8) || header.version < 1 || header.version > BRICKFILE_VERSION)
+	{
+		std::cerr << name << " is not a version 1 to " << BRICKFILE_VERSION << " brick file\n";
+		Close();
+		return false;
+	}
+
+	// Version 1 headers stop before the codec
+
+	size_t hsz = sizeof(header);
+	if (header.version == 1)
+	{
+		hsz = offsetof(BrickFileHeader, codec);
+		header.codec = BRICK_RAW;
+	}
+
+	header.type[sizeof(header.type)-1] = 0;
+	if (! type_size(header.type))
+	{
+		std::cerr << name << ": unsupported voxel type " << header.type << "\n";
+		Close();
+		return false;
+	}
+
+	if (! CodecName(header.codec) || (quantized_bits(header.codec) && strcmp(header.type, "float")))
+	{
+		std::cerr << name << ": unsupported codec " << header.codec << " for " << header.type << " voxels\n";
+		Close();
+		return false;
+	}
+
+	nbx = (header.dims[0] + header.brick[0] - 1) / header.brick[0];
+	nby = (header.dims[1] + header.brick[1] - 1) / header.brick[1];
+	nbz = (header.dims[2] + header.brick[2] - 1) / header.brick[2];
+
+	offsets.resize(header.nbricks + 1);
+	size_t osz = offsets.size() * sizeof(uint64_t);
+
+	ranges.clear();
+	if (header.version > 1)
+		ranges.resize(2 * header.nbricks);
+	size_t rsz = ranges.size() * sizeof(float);
+
+	if (header.nbricks != nbx*nby*nbz || pread(fd, &offsets[0], osz, hsz) != (ssize_t)osz ||
+			(rsz && pread(fd, &ranges[0], rsz, hsz + osz) != (ssize_t)rsz))
+	{
+		std::cerr << name << ": bad brick table\n";
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void
+BrickFile::GetDimensions(int& _x, int& _y, int& _z)
+{
+	_x = header.dims[0]; _y = header.dims[1]; _z = header.dims[2];
+}
+
+void
+BrickFile::GetBrickSize(int& _x, int& _y, int& _z)
+{
+	_x = header.brick[0]; _y = header.brick[1]; _z = header.brick[2];
+}
+
+int
+BrickFile::GetVoxelSize()
+{
+	return type_size(header.type);
+}
+
+void
+BrickFile::GetBrickBox(int b, int lo[3], int hi[3])
+{
+	int i[3] = { b % nbx, (b / nbx) % nby, b / (nbx * nby) };
+	for (int k = 0; k < 3; k++)
+	{
+		lo[k] = i[k] * header.brick[k];
+		hi[k] = lo[k] + header.brick[k];
+		if (hi[k] > header.dims[k]) hi[k] = header.dims[k];
+	}
+}
+
+size_t
+BrickFile::GetBrickBytes(int b)
+{
+	int lo[3], hi[3];
+	GetBrickBox(b, lo, hi);
+	return ((size_t)(hi[0]-lo[0]))*(hi[1]-lo[1])*(hi[2]-lo[2])*GetVoxelSize();
+}
+
+bool
+BrickFile::GetBrickRange(int b, float& m, float& M)
+{
+	if (ranges.empty())
+		return false;
+
+	m = ranges[2*b];
+	M = ranges[2*b+1];
+	return true;
+}
+
+bool
+BrickFile::GetMacrocells(int size, std::vector<float>& cells)
+{
+	if (ranges.empty() || size <= 0)
+		return false;
+
+	const int *d = header.dims, *s = header.brick;
+
+	int nx, ny, nz;
+	MacrocellCount(d[0], d[1], d[2], size, nx, ny, nz);
+	cells.resize(2 * (size_t)nx * ny * nz);
+
+	// A cell covers voxels [c*size, c*size + size] (clipped), and takes the
+	// union of the ranges of every brick that voxel box touches
+
+	int b0[3], b1[3];
+	float *r = &cells[0];
+	for (int k = 0; k < nz; k++)
+	{
+		b0[2] = (k * size) / s[2];
+		b1[2] = ((k * size + size < d[2] - 1) ? k * size + size : d[2] - 1) / s[2];
+
+		for (int j = 0; j < ny; j++)
+		{
+			b0[1] = (j * size) / s[1];
+			b1[1] = ((j * size + size < d[1] - 1) ? j * size + size : d[1] - 1) / s[1];
+
+			for (int i = 0; i < nx; i++, r += 2)
+			{
+				b0[0] = (i * size) / s[0];
+				b1[0] = ((i * size + size < d[0] - 1) ? i * size + size : d[0] - 1) / s[0];
+
+				bool first = true;
+				for (int bz = b0[2]; bz <= b1[2]; bz++)
+					for (int by = b0[1]; by <= b1[1]; by++)
+						for (int bx = b0[0]; bx <= b1[0]; bx++)
+						{
+							const float *br = &ranges[2 * (bx + nbx * (by + nby * bz))];
+							if (first || br[0] < r[0]) r[0] = br[0];
+							if (first || br[1] > r[1]) r[1] = br[1];
+							first = false;
+						}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool
+BrickFile::readAt(uint64_t offset, size_t sz, void *dst)
+{
+	size_t done = 0;
+	while (done < sz)
+	{
+		ssize_t n = pread(fd, (char *)dst + done, sz - done, offset + done);
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+bool
+BrickFile::ReadBrick(int b, void *dst)
+{
+	if (header.codec == BRICK_RAW)
+	{
+		if (! readAt(offsets[b], GetStoredBytes(b), dst))
+		{
+			std::cerr << "error reading brick " << b << "\n";
+			return false;
+		}
+		return true;
+	}
+
+	std::vector<char> stored(GetStoredBytes(b));
+	if (stored.empty() || ! readAt(offsets[b], stored.size(), &stored[0]))
+	{
+		std::cerr << "error reading brick " << b << "\n";
+		return false;
+	}
+
+	size_t sz = GetBrickBytes(b);
+
+	if (header.codec == BRICK_ZLIB)
+	{
+		uLongf len = sz;
+		if (uncompress((Bytef *)dst, &len, (const Bytef *)&stored[0], stored.size()) != Z_OK || len != sz)
+		{
+			std::cerr << "error decompressing brick " << b << "\n";
+			return false;
+		}
+	}
+	else
+		dequantize(&stored[0], sz / sizeof(float), ranges[2*b], ranges[2*b+1], quantized_bits(header.codec), (float *)dst);
+
+	return true;
+}
+
+// One task per brick: decode, then scatter into the volume
+
+class ReadAllTask : public ParallelTask
+{
+public:
+	ReadAllTask(BrickFile *f, char *d) : file(f), dst(d), failed(false)
+	{
+		file->GetDimensions(x, y, z);
+		vsz = file->GetVoxelSize();
+	}
+
+	void run(int b, int count)
+	{
+		std::vector<char> brick(file->GetBrickBytes(b));
+		if (! file->ReadBrick(b, &brick[0]))
+		{
+			failed = true;
+			return;
+		}
+
+		int lo[3], hi[3];
+		file->GetBrickBox(b, lo, hi);
+
+		const char *src = &brick[0];
+		size_t row = (hi[0] - lo[0])*vsz;
+		for (int k = lo[2]; k < hi[2]; k++)
+			for (int j = lo[1]; j < hi[1]; j++, src += row)
+				memcpy(dst + ((((size_t)k)*y + j)*x + lo[0])*vsz, src, row);
+	}
+
+	BrickFile			*file;
+	char					*dst;
+	int						x, y, z, vsz;
+	volatile bool	failed;
+};
+
+bool
+BrickFile::ReadAll(void *dst)
+{
+	ReadAllTask task(this, (char *)dst);
+	ParallelRun(task, header.nbricks);
+	return ! task.failed;
+}
+
+// Encodes a batch of consecutive bricks, one task per brick.  Bricks
+// are gathered from an x-fastest volume, or if starts is given taken
+// whole from the voxel offsets it lists.
+
+class EncodeTask : public ParallelTask
+{
+public:
+	EncodeTask(BrickFile *f, const void *v, const std::string& t, int c, int l, float *r, const size_t *s) :
+		file(f), voxels((const char *)v), type(t), codec(c), level(l), ranges(r), starts(s), first(0), failed(false)
+	{
+		file->GetDimensions(x, y, z);
+		vsz = file->GetVoxelSize();
+	}
+
+	void run(int i, int count)
+	{
+		int b = first + i;
+
+		int lo[3], hi[3];
+		file->GetBrickBox(b, lo, hi);
+
+		size_t n = ((size_t)(hi[0]-lo[0]))*(hi[1]-lo[1])*(hi[2]-lo[2]);
+		std::vector<char> raw(n * vsz);
+
+		if (starts)
+			memcpy(&raw[0], voxels + starts[b]*vsz, raw.size());
+		else
+		{
+			char *dst = &raw[0];
+			size_t row = (hi[0] - lo[0])*vsz;
+			for (int k = lo[2]; k < hi[2]; k++)
+				for (int j = lo[1]; j < hi[1]; j++, dst += row)
+					memcpy(dst, voxels + ((((size_t)k)*y + j)*x + lo[0])*vsz, row);
+		}
+
+		float *r = ranges + 2*b;
+		brick_range(&raw[0], n, type, r[0], r[1]);
+
+		std::vector<char>& out = encoded[i];
+		int bits = quantized_bits(codec);
+
+		if (codec == BRICK_RAW)
+			out.swap(raw);
+		else if (codec == BRICK_ZLIB)
+		{
+			uLongf len = compressBound(raw.size());
+			out.resize(len);
+			if (compress2((Bytef *)&out[0], &len, (const Bytef *)&raw[0], raw.size(), level) != Z_OK)
+				failed = true;
+			out.resize(len);
+		}
+		else
+		{
+			out.resize(n * bits / 8);
+			quantize((const float *)&raw[0], n, r[0], r[1], bits, &out[0]);
+		}
+	}
+
+	BrickFile				*file;
+	const char			*voxels;
+	std::string			type;
+	int							codec, level;
+	float						*ranges;
+	const size_t		*starts;
+	int							x, y, z, vsz;
+
+	int							first;
+	std::vector< std::vector<char> > encoded;
+	volatile bool		failed;
+};
+
+bool
+BrickFile::Write(const std::string& name, const std::string& type,
+								 int x, int y, int z, int bx, int by, int bz, const void *voxels,
+								 int codec, int level, bool bricked)
+{
+	int vsz = type_size(type);
+	if (! vsz)
+	{
+		std::cerr << "unsupported voxel type " << type << "\n";
+		return false;
+	}
+
+	if (! CodecName(codec) || (quantized_bits(codec) && type != "float"))
+	{
+		std::cerr << "codec " << (CodecName(codec) ? CodecName(codec) : "?") << " can't be used for " << type << " voxels\n";
+		return false;
+	}
+
+	BrickFile tmp;
+	BrickFileHeader& h = tmp.header;
+	memcpy(h.magic, BRICKFILE_MAGIC, 8);
+	h.version = BRICKFILE_VERSION;
+	h.dims[0] = x;  h.dims[1] = y;  h.dims[2] = z;
+	h.brick[0] = bx; h.brick[1] = by; h.brick[2] = bz;
+	strncpy(h.type, type.c_str(), sizeof(h.type)-1);
+	h.codec = codec;
+
+	tmp.nbx = (x + bx - 1) / bx;
+	tmp.nby = (y + by - 1) / by;
+	tmp.nbz = (z + bz - 1) / bz;
+	h.nbricks = tmp.nbx * tmp.nby * tmp.nbz;
+
+	tmp.offsets.resize(h.nbricks + 1);
+	tmp.ranges.resize(2 * h.nbricks);
+	tmp.offsets[0] = sizeof(h) + tmp.offsets.size()*sizeof(uint64_t) + tmp.ranges.size()*sizeof(float);
+
+	FILE *fp = fopen(name.c_str(), "wb");
+	if (! fp)
+	{
+		std::cerr << "can't create " << name << "\n";
+		return false;
+	}
+
+	// Payload sizes aren't known until the bricks are encoded, so the
+	// header and tables are written last.  Bricks are encoded a batch at a
+	// time to bound the memory held.
+
+	bool ok = fseeko(fp, tmp.offsets[0], SEEK_SET) == 0;
+
+	// Bricks are stored back to back, so in brick order each one starts
+	// where the one before ends
+
+	std::vector<size_t> starts;
+	if (bricked)
+	{
+		starts.resize(h.nbricks);
+		size_t s = 0;
+		for (int b = 0; b < h.nbricks; b++)
+		{
+			starts[b] = s;
+			s += tmp.GetBrickBytes(b) / vsz;
+		}
+	}
+
+	EncodeTask task(&tmp, voxels, type, codec, level, &tmp.ranges[0], bricked ? &starts[0] : NULL);
+	int batch = 4*ParallelThreadCount();
+
+	for (int b = 0; ok && b < h.nbricks; b += batch)
+	{
+		int n = h.nbricks - b < batch ? h.nbricks - b : batch;
+
+		task.first = b;
+		task.encoded.assign(n, std::vector<char>());
+		ParallelRun(task, n);
+
+		if (task.failed)
+		{
+			std::cerr << "error compressing bricks\n";
+			ok = false;
+		}
+
+		for (int i = 0; ok && i < n; i++)
+		{
+			std::vector<char>& e = task.encoded[i];
+			ok = fwrite(&e[0], 1, e.size(), fp) == e.size();
+			tmp.offsets[b+i+1] = tmp.offsets[b+i] + e.size();
+		}
+	}
+
+	h.min = tmp.ranges[0];
+	h.max = tmp.ranges[1];
+	for (int b = 1; b < h.nbricks; b++)
+	{
+		if (tmp.ranges[2*b] < h.min) h.min = tmp.ranges[2*b];
+		if (tmp.ranges[2*b+1] > h.max) h.max = tmp.ranges[2*b+1];
+	}
+
+	if (ok)
+	{
+		ok = fseeko(fp, 0, SEEK_SET) == 0;
+		fwrite(&h, sizeof(h), 1, fp);
+		fwrite(&tmp.offsets[0], sizeof(uint64_t), tmp.offsets.size(), fp);
+		fwrite(&tmp.ranges[0], sizeof(float), tmp.ranges.size(), fp);
+	}
+
+	ok = ok && ! ferror(fp);
+	fclose(fp);
+
+	if (! ok)
+		std::cerr << "error writing " << name << "\n";
+
+	return ok;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A pre-bricked volume on disk (.brk).  The volume is cut into fixed
+// size bricks (edge bricks are clipped to the volume) and each brick is
+// stored contiguously, x-fastest within the brick, bricks in x-fastest
+// order over the brick grid.  The file is:
+//
+//		BrickFileHeader
+//		uint64_t offsets[nbricks + 1]		byte offset of each brick; the last
+//																		entry is the end of the file
+//		float ranges[2 * nbricks]				min and max of each brick (version 2)
+//		brick payloads
+//
+// Bricks that span the whole x extent of the volume (the default of
+// vol2brk) are the cheapest to page in and out of a shared volume,
+// since each z plane of such a brick is one contiguous run of memory.
+//
+// From version 2 each brick payload is encoded with the file's codec:
+//
+//		raw		the voxels as they are
+//		zlib	deflated voxels
+//		q16		float voxels quantized to 16 bits over the brick's range
+//		q8		float voxels quantized to 8 bits over the brick's range
+//
+// The quantized codecs are lossy and fixed rate; the error of a voxel is
+// at most half a step, (max - min) / 2(2^bits - 1), of its brick.
+// Version 1 files (raw, no brick ranges) can still be read.
+
+#define BRICKFILE_MAGIC "VVBRICK"
+#define BRICKFILE_VERSION 2
+
+enum BrickCodec { BRICK_RAW, BRICK_ZLIB, BRICK_Q16, BRICK_Q8 };
+
+struct BrickFileHeader
+{
+	char		magic[8];
+	int32_t	version;
+	int32_t	dims[3];
+	int32_t	brick[3];
+	char		type[16];
+	float		min, max;
+	int32_t	nbricks;
+	int32_t	codec;						// version 2 on
+};
+
+class BrickFile
+{
+public:
+		BrickFile();
+		~BrickFile();
+
+		bool Open(const std::string& name);
+		void Close();
+
+		// Write a volume held in memory (x-fastest) as a brick file.  Bricks
+		// are encoded in parallel; level is the zlib compression level.
+		// With bricked set the voxels are already in brick order, laid out
+		// as the payload of a raw brick file of this brick size (as
+		// PerlinTBricked makes them), and are taken a brick at a time.
+
+		static bool Write(const std::string& name, const std::string& type,
+											int x, int y, int z, int bx, int by, int bz, const void *voxels,
+											int codec = BRICK_RAW, int level = 1, bool bricked = false);
+
+		// Codec by name ("raw", "zlib", "q16", "q8"); -1 if unknown
+
+		static int CodecFromName(const std::string& name);
+		static const char *CodecName(int codec);
+
+		void GetDimensions(int& _x, int& _y, int& _z);
+		void GetBrickSize(int& _x, int& _y, int& _z);
+		void GetType(std::string& _t) { _t = header.type; }
+		void GetMinMax(float& _m, float& _M) { _m = header.min; _M = header.max; }
+		int  GetVoxelSize();
+		int  GetCodec() { return header.codec; }
+
+		int  GetNumberOfBricks() { return header.nbricks; }
+
+		// Voxel box [lo, hi) covered by brick b
+
+		void GetBrickBox(int b, int lo[3], int hi[3]);
+
+		// Size of brick b once decoded, and as stored in the file
+
+		size_t GetBrickBytes(int b);
+		size_t GetStoredBytes(int b) { return offsets[b+1] - offsets[b]; }
+
+		// Value range of brick b.  Returns false for version 1 files, which
+		// don't record it.
+
+		bool GetBrickRange(int b, float& m, float& M);
+
+		// Macrocell ranges (see Macrocells.h) for the given cell size, made
+		// from the brick ranges without reading any voxels.  Coarser than
+		// ranges computed from the voxels when the bricks are bigger than
+		// the cells.  Returns false if the file has no brick ranges.
+
+		bool GetMacrocells(int size, std::vector<float>& cells);
+
+		// Read and decode brick b into dst (GetBrickBytes(b) bytes).  Safe
+		// to call from several threads at once.
+
+		bool ReadBrick(int b, void *dst);
+
+		// Read and decode every brick, in parallel, into dst as one
+		// x-fastest volume
+
+		bool ReadAll(void *dst);
+
+private:
+		bool readAt(uint64_t offset, size_t sz, void *dst);
+
+		int 										fd;
+		BrickFileHeader					header;
+		int											nbx, nby, nbz;
+		std::vector<uint64_t>		offsets;
+		std::vector<float>			ranges;
+};
@@ -1,6 +1,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include "Camera.h"
+#include "Commits.h"
+#include "Trace.h"
 #define PI 3.1415926
 
 void
@@ -133,6 +135,52 @@ Camera::setAspect(float a)
 	aspect = a; modified = true;
 }
 
+static void
+set_plane(float *p, osp::vec3f n, osp::vec3f e)
+{
+	n = normalize(n);
+	p[0] = n.x; p[1] = n.y; p[2] = n.z;
+	p[3] = -(n.x*e.x + n.y*e.y + n.z*e.z);
+}
+
+void
+Camera::getFrustum(float planes[5][4])
+{
+	osp::vec3f f = normalize(center - pos);
+	osp::vec3f r = normalize(cross(f, up));
+	osp::vec3f u = cross(r, f);
+
+	float ty = tan(0.5 * aov * PI / 180.0);
+	float tx = ty * (aspect > 1 ? aspect : 1 / aspect);
+
+	set_plane(planes[0], tx*f - r, pos);
+	set_plane(planes[1], tx*f + r, pos);
+	set_plane(planes[2], ty*f - u, pos);
+	set_plane(planes[3], ty*f + u, pos);
+	set_plane(planes[4], f, pos);
+}
+
+bool
+Camera::project(const osp::vec3f& p, float& sx, float& sy)
+{
+	// As ospray::PerspectiveCamera::commit sets up its rays
+	osp::vec3f f = normalize(committedDir);
+	osp::vec3f du = normalize(cross(f, committedUp));
+	osp::vec3f dv = cross(du, f);
+
+	float sy_size = 2 * tan(0.5 * committedAov * PI / 180.0);
+	float sx_size = sy_size * committedAspect;
+
+	osp::vec3f d = p - committedPos;
+	float z = dot(d, f);
+	if (z <= 1e-6 * (fabs(d.x) + fabs(d.y) + fabs(d.z)))
+		return false;
+
+	sx = 0.5 + dot(d, du) / (z * sx_size);
+	sy = 0.5 + dot(d, dv) / (z * sy_size);
+	return true;
+}
+
 void 
 Camera::setupFrame()
 {
@@ -201,15 +249,37 @@ Camera::loadState(Value& cam)
 	commit();
 }
 
+static bool
+same(osp::vec3f& a, osp::vec3f& b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
 void 
 Camera::commit()
 {
-	ospSetVec3f(ospCamera,"pos", pos);
-	ospSetVec3f(ospCamera,"dir", dir);
-	ospSetVec3f(ospCamera,"up",  up);
-	ospSetf(ospCamera,"aspect",  aspect);
-	ospSetf(ospCamera,"fovy",    aov);
-	ospCommit(ospCamera);
+	TraceScope trace(TRACE_CAMERA_COMMIT);
+
+	if (committed && same(pos, committedPos) && same(dir, committedDir) && same(up, committedUp) &&
+			aspect == committedAspect && aov == committedAov)
+		CountCommit(COMMIT_CAMERA, false);
+	else
+	{
+		ospSetVec3f(ospCamera,"pos", pos);
+		ospSetVec3f(ospCamera,"dir", dir);
+		ospSetVec3f(ospCamera,"up",  up);
+		ospSetf(ospCamera,"aspect",  aspect);
+		ospSetf(ospCamera,"fovy",    aov);
+		ospCommit(ospCamera);
+
+		committed = true;
+		committedPos = pos;
+		committedDir = dir;
+		committedUp = up;
+		committedAspect = aspect;
+		committedAov = aov;
+		CountCommit(COMMIT_CAMERA, true);
+	}
 
 	cameraLights.commit(renderer, frame);
 }
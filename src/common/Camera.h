@@ -14,7 +14,7 @@
 class Camera
 {
 public:
-	Camera() : modified(true), phi(0.0), theta(0.0) {
+	Camera() : modified(true), committed(false), phi(0.0), theta(0.0) {
 		frame = osp::affine3f(embree::one);
 		ospCamera = ospNewCamera("perspective");
 		modified = true;
@@ -53,6 +53,18 @@ public:
 	void setFovY(float f);
 	void setAspect(float a);
 
+	// View frustum as the four side planes and a plane through the eye,
+	// each (nx, ny, nz, d) with n.p + d >= 0 on the inside.  Errs on the
+	// wide side if the aspect ratio is given upside down.
+
+	void getFrustum(float planes[5][4]);
+
+	// Where OSPRay's perspective camera, as last committed, sees p: screen
+	// coordinates in [0, 1] across the image.  False if p is not in front
+	// of the camera.
+
+	bool project(const osp::vec3f& p, float& sx, float& sy);
+
 
 	void saveState(Document &doc, Value &section);
 	void loadState(Value& cam);
@@ -90,4 +102,10 @@ private:
 
 	float aspect;
 	bool modified;
+
+	// What the OSPRay camera was last given
+
+	bool committed;
+	osp::vec3f committedPos, committedDir, committedUp;
+	float committedAspect, committedAov;
 };
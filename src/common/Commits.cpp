@@ -0,0 +1,44 @@
+#include "Commits.h"
+
+static const char *names[N_COMMIT_KINDS] =
+{
+	"slices", "isosurfaces", "camera", "lights", "transfer function",
+	"render properties", "volume", "renderer"
+};
+
+static long made[N_COMMIT_KINDS];
+static long avoided[N_COMMIT_KINDS];
+static long total;
+
+void
+CountCommit(CommitKind kind, bool m)
+{
+	if (m)
+	{
+		__sync_fetch_and_add(&made[kind], 1);
+		__sync_fetch_and_add(&total, 1);
+	}
+	else
+		__sync_fetch_and_add(&avoided[kind], 1);
+}
+
+long
+CommitsMade()
+{
+	return __sync_fetch_and_add(&total, 0);
+}
+
+void
+ReportCommits(std::ostream& o)
+{
+	long m = 0, a = 0;
+
+	o << "commits made/avoided:\n";
+	for (int i = 0; i < N_COMMIT_KINDS; i++)
+	{
+		o << "  " << names[i] << ": " << made[i] << "/" << avoided[i] << "\n";
+		m += made[i];
+		a += avoided[i];
+	}
+	o << "  total: " << m << "/" << a << "\n";
+}
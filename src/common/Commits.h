@@ -0,0 +1,30 @@
+#pragma once
+
+#include <iostream>
+
+// Running tally of state pushed to OSPRay.  Each commit() that finds its
+// state unchanged since the last push skips the OSPRay calls and counts
+// as avoided.
+
+enum CommitKind
+{
+	COMMIT_SLICES,
+	COMMIT_ISOS,
+	COMMIT_CAMERA,
+	COMMIT_LIGHTS,
+	COMMIT_TRANSFERFUNCTION,
+	COMMIT_RENDERPROPERTIES,
+	COMMIT_VOLUME,
+	COMMIT_RENDERER,
+	N_COMMIT_KINDS
+};
+
+void CountCommit(CommitKind kind, bool made);
+
+// Total commits made so far, of any kind.  Anything that must follow
+// some other commit (e.g. the renderer) can compare this with what it
+// saw the last time it committed.
+
+long CommitsMade();
+
+void ReportCommits(std::ostream& o);
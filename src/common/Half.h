@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// IEEE 754 binary16 conversions.  Float to half rounds to nearest even
+// and saturates to infinity; NaNs stay NaNs.
+
+static inline uint16_t
+FloatToHalf(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, 4);
+
+	uint32_t sign = (u >> 16) & 0x8000;
+	uint32_t mag  = u & 0x7fffffff;
+
+	if (mag >= 0x7f800000)									// inf or NaN
+		return sign | 0x7c00 | (mag > 0x7f800000 ? 0x200 : 0);
+
+	if (mag >= 0x477ff000)									// rounds past 65504
+		return sign | 0x7c00;
+
+	if (mag < 0x38800000)										// half denormal or zero
+	{
+		if (mag < 0x33000000)
+			return sign;
+		uint32_t m = (mag & 0x7fffff) | 0x800000;
+		int shift = 126 - (mag >> 23);
+		uint32_t h = m >> shift;
+		uint32_t rem = m & ((1u << shift) - 1);
+		uint32_t half = 1u << (shift - 1);
+		if (rem > half || (rem == half && (h & 1)))
+			h++;
+		return sign | h;
+	}
+
+	uint32_t h = (mag - 0x38000000) >> 13;
+	uint32_t rem = mag & 0x1fff;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+		h++;
+	return sign | h;
+}
+
+static inline float
+HalfToFloat(uint16_t h)
+{
+	uint32_t sign = ((uint32_t)(h & 0x8000)) << 16;
+	uint32_t e = (h >> 10) & 0x1f;
+	uint32_t m = h & 0x3ff;
+	uint32_t u;
+
+	if (e == 0)
+	{
+		if (m == 0)
+			u = sign;
+		else
+		{
+			e = 113;
+			while (! (m & 0x400)) { m <<= 1; e--; }
+			u = sign | (e << 23) | ((m & 0x3ff) << 13);
+		}
+	}
+	else if (e == 31)
+		u = sign | 0x7f800000 | (m << 13);
+	else
+		u = sign | ((e + 112) << 23) | (m << 13);
+
+	float f;
+	memcpy(&f, &u, 4);
+	return f;
+}
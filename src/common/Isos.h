@@ -10,6 +10,7 @@
 #include "common.h"
 
 #include "Volume.h"
+#include "Trace.h"
 
 using namespace std;
 
@@ -66,8 +67,11 @@ public:
 		section.AddMember("Isosurfaces", a, doc.GetAllocator());
 	}
 
-	void commit(Volume *vol)
+	// Returns false if the volume already has these isovalues
+	bool commit(Volume *vol)
 	{
+		TraceScope trace(TRACE_ISOS_COMMIT);
+
 		float v[3];
 
 		int k = 0;
@@ -77,7 +81,7 @@ public:
 				v[k++]= min + values[i]*(max - min);
 			}
 
-		vol->SetIsovalues(k, v);
+		return vol->SetIsovalues(k, v);
   }
 
 private:
@@ -1,11 +1,37 @@
+#include <string.h>
+#include <pthread.h>
+#include <map>
+
 #include "Lights.h"
+#include "Commits.h"
+
+// A renderer may get its lights from more than one Lights (the camera's
+// and the scene's), so remember which one set them last.  A Lights goes
+// with the renderer it lights, and takes its entries with it, so the map
+// doesn't keep the handles of renderers that are gone.  Lanes and the
+// render server make and drop renderers on several threads.
 
-Lights::Lights()
+static std::map<OSPRenderer, Lights *> owner;
+static pthread_mutex_t ownerLock = PTHREAD_MUTEX_INITIALIZER;
+
+Lights::Lights() : committedRenderer(NULL), committedFramed(false)
 {
 	Light l;
 	lights.push_back(l);
 }
 
+Lights::~Lights()
+{
+	pthread_mutex_lock(&ownerLock);
+	std::map<OSPRenderer, Lights *>::iterator it = owner.begin();
+	while (it != owner.end())
+		if (it->second == this)
+			owner.erase(it++);
+		else
+			++it;
+	pthread_mutex_unlock(&ownerLock);
+}
+
 void
 Lights::addLight(osp::vec3f d, osp::vec3f c)
 {
@@ -13,9 +39,66 @@ Lights::addLight(osp::vec3f d, osp::vec3f c)
 	lights.push_back(l);
 }
 
+bool
+Lights::unchanged(OSPRenderer r, bool framed, osp::affine3f& frame)
+{
+	if (r != committedRenderer || framed != committedFramed)
+		return false;
+
+	pthread_mutex_lock(&ownerLock);
+	std::map<OSPRenderer, Lights *>::iterator it = owner.find(r);
+	bool mine = it != owner.end() && it->second == this;
+	pthread_mutex_unlock(&ownerLock);
+	if (! mine)
+		return false;
+
+	if (framed && memcmp(&frame, &committedFrame, sizeof(frame)))
+		return false;
+
+	if (lights.size() != committedLights.size())
+		return false;
+
+	for (int i = 0; i < lights.size(); i++)
+	{
+		const Light& a = lights[i];
+		const Light& b = committedLights[i];
+		if (a.x != b.x || a.y != b.y || a.z != b.z || a.r != b.r || a.g != b.g || a.b != b.b)
+			return false;
+	}
+
+	return true;
+}
+
+void
+Lights::setLights(OSPRenderer r, std::vector<OSPLight>& ospLights)
+{
+	// The data holds the lights and the renderer holds the data, so our
+	// references can go; the last set are freed when these replace them
+
+	OSPData d = ospNewData(ospLights.size(), OSP_OBJECT, ospLights.data());
+	for (size_t i = 0; i < ospLights.size(); i++)
+		ospRelease(ospLights[i]);
+	ospSetData(r, "lights", d);
+	ospRelease(d);
+
+	pthread_mutex_lock(&ownerLock);
+	owner[r] = this;
+	pthread_mutex_unlock(&ownerLock);
+
+	committedRenderer = r;
+	committedLights = lights;
+	CountCommit(COMMIT_LIGHTS, true);
+}
+
 void
 Lights::commit(OSPRenderer r, osp::affine3f frame)
 {
+	if (unchanged(r, true, frame))
+	{
+		CountCommit(COMMIT_LIGHTS, false);
+		return;
+	}
+
 	std::vector<OSPLight> ospLights;
 	for (int i = 0; i < lights.size(); i++)
 	{
@@ -29,13 +112,22 @@ Lights::commit(OSPRenderer r, osp::affine3f frame)
 		ospCommit(l);
 		ospLights.push_back(l);
 	}
-	ospSetData(r, "lights", ospNewData(ospLights.size(), OSP_OBJECT, ospLights.data()));
+	setLights(r, ospLights);
+	committedFrame = frame;
+	committedFramed = true;
 	ospCommit(r);
 }
 
 void
 Lights::commit(OSPRenderer r)
 {
+	osp::affine3f none;
+	if (unchanged(r, false, none))
+	{
+		CountCommit(COMMIT_LIGHTS, false);
+		return;
+	}
+
 	std::vector<OSPLight> ospLights;
 	for (int i = 0; i < lights.size(); i++)
 	{
@@ -45,7 +137,8 @@ Lights::commit(OSPRenderer r)
 		ospCommit(l);
 		ospLights.push_back(l);
 	}
-	ospSetData(r, "lights", ospNewData(ospLights.size(), OSP_OBJECT, ospLights.data()));
+	setLights(r, ospLights);
+	committedFramed = false;
 }
 
 void 
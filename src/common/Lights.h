@@ -34,6 +34,7 @@ class Lights {
 public:
 
   Lights();
+  ~Lights();
 
 	void addLight(osp::vec3f, osp::vec3f);
 	void commit(OSPRenderer r, osp::affine3f frame);
@@ -43,6 +44,15 @@ public:
 	void clear();
 
 private:
+	bool unchanged(OSPRenderer r, bool framed, osp::affine3f& frame);
+	void setLights(OSPRenderer r, std::vector<OSPLight>& l);
+
 	std::vector<Light> lights;
+
+	// What was last given to which renderer
+	OSPRenderer committedRenderer;
+	std::vector<Light> committedLights;
+	osp::affine3f committedFrame;
+	bool committedFramed;
 };
 	
@@ -0,0 +1,98 @@
+#include "Macrocells.h"
+#include "Parallel.h"
+
+static int
+cells(int n, int size)
+{
+	int c = (n - 1 + size - 1) / size;
+	return c < 1 ? 1 : c;
+}
+
+void
+MacrocellCount(int x, int y, int z, int size, int& nx, int& ny, int& nz)
+{
+	nx = cells(x, size);
+	ny = cells(y, size);
+	nz = cells(z, size);
+}
+
+// One task per z-slab of cells
+
+template<typename T>
+class MacrocellTask : public ParallelTask
+{
+public:
+	MacrocellTask(const T *v, int x, int y, int z, int s, float *r) :
+		voxels(v), xsz(x), ysz(y), zsz(z), size(s), ranges(r)
+	{
+		MacrocellCount(x, y, z, s, nx, ny, nz);
+	}
+
+	void run(int k, int count)
+	{
+		int z0 = k * size, z1 = z0 + size < zsz - 1 ? z0 + size : zsz - 1;
+
+		for (int j = 0; j < ny; j++)
+		{
+			int y0 = j * size, y1 = y0 + size < ysz - 1 ? y0 + size : ysz - 1;
+
+			for (int i = 0; i < nx; i++)
+			{
+				int x0 = i * size, x1 = x0 + size < xsz - 1 ? x0 + size : xsz - 1;
+
+				T m = voxels[x0 + (size_t)xsz * (y0 + (size_t)ysz * z0)], M = m;
+
+				for (int z = z0; z <= z1; z++)
+					for (int y = y0; y <= y1; y++)
+					{
+						const T *row = voxels + (size_t)xsz * (y + (size_t)ysz * z);
+						for (int x = x0; x <= x1; x++)
+						{
+							m = row[x] < m ? row[x] : m;
+							M = row[x] > M ? row[x] : M;
+						}
+					}
+
+				float *r = ranges + 2 * (i + (size_t)nx * (j + (size_t)ny * k));
+				r[0] = (float)m;
+				r[1] = (float)M;
+			}
+		}
+	}
+
+	int nx, ny, nz;
+
+private:
+	const T *voxels;
+	int xsz, ysz, zsz, size;
+	float *ranges;
+};
+
+template<typename T>
+static void
+compute(const T *v, int x, int y, int z, int size, std::vector<float>& ranges)
+{
+	int nx, ny, nz;
+	MacrocellCount(x, y, z, size, nx, ny, nz);
+	ranges.resize(2 * (size_t)nx * ny * nz);
+
+	MacrocellTask<T> task(v, x, y, z, size, &ranges[0]);
+	ParallelRun(task, nz);
+}
+
+bool
+ComputeMacrocells(const void *voxels, const std::string& type, int x, int y, int z, int size, std::vector<float>& ranges)
+{
+	if (type == "float")
+		compute((const float *)voxels, x, y, z, size, ranges);
+	else if (type == "uchar")
+		compute((const unsigned char *)voxels, x, y, z, size, ranges);
+	else if (type == "ushort")
+		compute((const unsigned short *)voxels, x, y, z, size, ranges);
+	else if (type == "short")
+		compute((const short *)voxels, x, y, z, size, ranges);
+	else
+		return false;
+
+	return true;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Coarse value-range grid for empty-space skipping.  The volume is cut
+// into cells of size^3 voxels; neighbouring cells share their boundary
+// voxels, so a cell's range covers every value trilinear interpolation
+// can produce anywhere inside it.  Cells are ordered x-fastest and cell
+// c has its min at ranges[2*c] and its max at ranges[2*c+1].
+
+void MacrocellCount(int x, int y, int z, int size, int& nx, int& ny, int& nz);
+
+// type is the OSPRay voxelType string.  Returns false if the type is not
+// supported.
+
+bool ComputeMacrocells(const void *voxels, const std::string& type, int x, int y, int z, int size, std::vector<float>& ranges);
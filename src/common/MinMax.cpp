@@ -0,0 +1,295 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "MinMax.h"
+#include "Parallel.h"
+
+// Below this many voxels the threads cost more than they save
+
+#define MINMAX_SERIAL_LIMIT	(1 << 18)
+
+// Independent accumulators per chunk; the inner loop over a lane block
+// is branch-free so the compiler can turn it into packed min/max
+
+#define MINMAX_LANES	16
+
+// Per-type histogram key mapping
+
+template<typename T> struct VoxelKey;
+
+template<> struct VoxelKey<unsigned char>
+{
+	static const int nbins = 256;
+	static int bin(unsigned char v) { return v; }
+	static float value(int b) { return (float)b; }
+};
+
+template<> struct VoxelKey<unsigned short>
+{
+	static const int nbins = 65536;
+	static int bin(unsigned short v) { return v; }
+	static float value(int b) { return (float)b; }
+};
+
+template<> struct VoxelKey<short>
+{
+	static const int nbins = 65536;
+	static int bin(short v) { return v + 32768; }
+	static float value(int b) { return (float)(b - 32768); }
+};
+
+template<> struct VoxelKey<float>
+{
+	static const int nbins = 65536;
+
+	// Flip the sign bit of positives and all bits of negatives so that
+	// the unsigned integer order matches the float order
+
+	static uint32_t key(float v)
+	{
+		uint32_t u; memcpy(&u, &v, 4);
+		return (u & 0x80000000) ? ~u : (u | 0x80000000);
+	}
+
+	static float unkey(uint32_t k)
+	{
+		uint32_t u = (k & 0x80000000) ? (k & 0x7fffffff) : ~k;
+		float f; memcpy(&f, &u, 4);
+		return f;
+	}
+
+	static int bin(float v) { return key(v) >> 16; }
+
+	// Midpoint of the values covered by a bin
+
+	static float value(int b)
+	{
+		float lo = unkey(((uint32_t)b) << 16);
+		float hi = unkey((((uint32_t)b) << 16) | 0xffff);
+		return 0.5f*(lo + hi);
+	}
+};
+
+template<typename T>
+static void
+minmax_serial(const T *v, size_t n, T& lo, T& hi)
+{
+	T l[MINMAX_LANES], h[MINMAX_LANES];
+	for (int j = 0; j < MINMAX_LANES; j++)
+		l[j] = h[j] = v[0];
+
+	size_t i = 0;
+	for (; i + MINMAX_LANES <= n; i += MINMAX_LANES)
+		for (int j = 0; j < MINMAX_LANES; j++)
+		{
+			T x = v[i + j];
+			l[j] = x < l[j] ? x : l[j];
+			h[j] = x > h[j] ? x : h[j];
+		}
+
+	for (; i < n; i++)
+	{
+		T x = v[i];
+		l[0] = x < l[0] ? x : l[0];
+		h[0] = x > h[0] ? x : h[0];
+	}
+
+	lo = l[0]; hi = h[0];
+	for (int j = 1; j < MINMAX_LANES; j++)
+	{
+		if (l[j] < lo) lo = l[j];
+		if (h[j] > hi) hi = h[j];
+	}
+}
+
+template<typename T>
+static void
+minmax_histogram_serial(const T *v, size_t n, T& lo, T& hi, size_t *counts)
+{
+	lo = hi = v[0];
+	for (size_t i = 0; i < n; i++)
+	{
+		T x = v[i];
+		lo = x < lo ? x : lo;
+		hi = x > hi ? x : hi;
+		counts[VoxelKey<T>::bin(x)]++;
+	}
+}
+
+template<typename T>
+class MinMaxTask : public ParallelTask
+{
+public:
+	MinMaxTask(const T *_v, size_t _n, int nchunks, bool histogram)
+		: v(_v), n(_n), lo(nchunks), hi(nchunks)
+	{
+		if (histogram)
+			counts.resize(nchunks * VoxelKey<T>::nbins, 0);
+	}
+
+	void run(int i, int count)
+	{
+		size_t s = (n * i) / count;
+		size_t e = (n * (i + 1)) / count;
+		if (s == e)
+		{
+			lo[i] = hi[i] = v[0];
+			return;
+		}
+
+		if (counts.size())
+			minmax_histogram_serial(v + s, e - s, lo[i], hi[i], &counts[i * VoxelKey<T>::nbins]);
+		else
+			minmax_serial(v + s, e - s, lo[i], hi[i]);
+	}
+
+	const T							*v;
+	size_t							n;
+	std::vector<T>			lo, hi;
+	std::vector<size_t> counts;
+};
+
+template<typename T>
+static void
+compute_minmax(const T *v, size_t n, float& m, float& M, VoxelHistogram *h)
+{
+	if (h)
+	{
+		h->counts.assign(VoxelKey<T>::nbins, 0);
+		h->min = h->max = 0;
+	}
+
+	if (n == 0)
+	{
+		m = M = 0;
+		return;
+	}
+
+	// Histogram chunks each carry a private set of bins, so keep their
+	// number down to one per thread
+
+	int nt = ParallelThreadCount();
+	int nchunks = (n < MINMAX_SERIAL_LIMIT) ? 1 : (h ? nt : 4*nt);
+
+	MinMaxTask<T> task(v, n, nchunks, h != NULL);
+	if (nchunks == 1)
+		task.run(0, 1);
+	else
+		ParallelRun(task, nchunks);
+
+	T lo = task.lo[0], hi = task.hi[0];
+	for (int i = 1; i < nchunks; i++)
+	{
+		if (task.lo[i] < lo) lo = task.lo[i];
+		if (task.hi[i] > hi) hi = task.hi[i];
+	}
+
+	m = (float)lo;
+	M = (float)hi;
+
+	if (h)
+	{
+		h->min = m;
+		h->max = M;
+		for (int i = 0; i < nchunks; i++)
+		{
+			const size_t *c = &task.counts[i * VoxelKey<T>::nbins];
+			for (int j = 0; j < VoxelKey<T>::nbins; j++)
+				h->counts[j] += c[j];
+		}
+	}
+}
+
+void
+ComputeMinMax(const float *v, size_t n, float& m, float& M, VoxelHistogram *h)
+{
+	if (h) h->type = "float";
+	compute_minmax(v, n, m, M, h);
+}
+
+void
+ComputeMinMax(const unsigned char *v, size_t n, float& m, float& M, VoxelHistogram *h)
+{
+	if (h) h->type = "uchar";
+	compute_minmax(v, n, m, M, h);
+}
+
+void
+ComputeMinMax(const unsigned short *v, size_t n, float& m, float& M, VoxelHistogram *h)
+{
+	if (h) h->type = "ushort";
+	compute_minmax(v, n, m, M, h);
+}
+
+void
+ComputeMinMax(const short *v, size_t n, float& m, float& M, VoxelHistogram *h)
+{
+	if (h) h->type = "short";
+	compute_minmax(v, n, m, M, h);
+}
+
+bool
+ComputeMinMax(const void *v, size_t n, const std::string& type, float& m, float& M, VoxelHistogram *h)
+{
+	if (type == "float")
+		ComputeMinMax((const float *)v, n, m, M, h);
+	else if (type == "uchar")
+		ComputeMinMax((const unsigned char *)v, n, m, M, h);
+	else if (type == "ushort")
+		ComputeMinMax((const unsigned short *)v, n, m, M, h);
+	else if (type == "short")
+		ComputeMinMax((const short *)v, n, m, M, h);
+	else
+		return false;
+
+	return true;
+}
+
+template<typename T>
+static float
+bin_value(int b)
+{
+	return VoxelKey<T>::value(b);
+}
+
+size_t
+VoxelHistogram::Total() const
+{
+	size_t t = 0;
+	for (size_t i = 0; i < counts.size(); i++)
+		t += counts[i];
+	return t;
+}
+
+void
+VoxelHistogram::Rebin(int n, std::vector<size_t>& h) const
+{
+	h.assign(n, 0);
+	if (n <= 0 || counts.empty())
+		return;
+
+	float (*value)(int) = bin_value<unsigned char>;
+	if (type == "float")
+		value = bin_value<float>;
+	else if (type == "ushort")
+		value = bin_value<unsigned short>;
+	else if (type == "short")
+		value = bin_value<short>;
+
+	float d = max - min;
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		if (! counts[i])
+			continue;
+
+		int b = 0;
+		if (d > 0)
+		{
+			float x = (value(i) - min) / d;
+			b = (int)(x * n);
+			if (b < 0) b = 0;
+			if (b >= n) b = n - 1;
+		}
+		h[b] += counts[i];
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Multithreaded min/max reduction over a voxel buffer, optionally
+// producing a value histogram in the same pass.
+//
+// Histograms are kept in a type-specific key space: 8- and 16-bit types
+// get one bin per representable value, floats get one bin per value of
+// the top 16 bits of an order-preserving integer key (so the bins are
+// exponentially spaced, like the floats themselves).  Use Rebin to
+// resample to N linear bins over [min, max].
+
+class VoxelHistogram
+{
+public:
+		VoxelHistogram() : min(0), max(0) {}
+
+		void Rebin(int n, std::vector<size_t>& h) const;
+		size_t Total() const;
+
+		std::string					type;
+		float								min, max;
+		std::vector<size_t>	counts;
+};
+
+// type is the OSPRay voxelType string ("uchar", "short", "ushort" or
+// "float").  Returns false if the type is not supported.  h may be NULL.
+
+bool ComputeMinMax(const void *v, size_t n, const std::string& type, float& m, float& M, VoxelHistogram *h = NULL);
+
+// Plain overloads for callers that know the element type
+
+void ComputeMinMax(const float *v, size_t n, float& m, float& M, VoxelHistogram *h = NULL);
+void ComputeMinMax(const unsigned char *v, size_t n, float& m, float& M, VoxelHistogram *h = NULL);
+void ComputeMinMax(const unsigned short *v, size_t n, float& m, float& M, VoxelHistogram *h = NULL);
+void ComputeMinMax(const short *v, size_t n, float& m, float& M, VoxelHistogram *h = NULL);
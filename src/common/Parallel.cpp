@@ -0,0 +1,65 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <vector>
+
+#include "Parallel.h"
+
+struct ParallelJob
+{
+	ParallelTask  *task;
+	int						count;
+	volatile int	next;
+};
+
+static void *
+parallel_worker(void *arg)
+{
+	ParallelJob *job = (ParallelJob *)arg;
+
+	int i;
+	while ((i = __sync_fetch_and_add(&job->next, 1)) < job->count)
+		job->task->run(i, job->count);
+
+	return NULL;
+}
+
+int
+ParallelThreadCount()
+{
+	static int n = 0;
+
+	if (n == 0)
+	{
+		const char *e = getenv("VOLVIEWER_THREADS");
+		n = e ? atoi(e) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (n < 1) n = 1;
+	}
+
+	return n;
+}
+
+void
+ParallelRun(ParallelTask& task, int count)
+{
+	ParallelJob job;
+	job.task  = &task;
+	job.count = count;
+	job.next  = 0;
+
+	int nt = ParallelThreadCount();
+	if (nt > count) nt = count;
+
+	std::vector<pthread_t> threads;
+	for (int i = 1; i < nt; i++)
+	{
+		pthread_t t;
+		if (pthread_create(&t, NULL, parallel_worker, (void *)&job) == 0)
+			threads.push_back(t);
+	}
+
+	parallel_worker((void *)&job);
+
+	for (size_t i = 0; i < threads.size(); i++)
+		pthread_join(threads[i], NULL);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// A minimal fork/join helper.  Subclass ParallelTask and ParallelRun
+// calls run(i, count) once for each i in [0, count), spread across the
+// available cores.  The calling thread takes part, and ParallelRun
+// returns when every index is done.
+
+class ParallelTask
+{
+public:
+	virtual ~ParallelTask() {}
+	virtual void run(int index, int count) = 0;
+};
+
+// Number of worker threads used; defaults to the number of online
+// cores, or VOLVIEWER_THREADS if set
+
+int  ParallelThreadCount();
+void ParallelRun(ParallelTask& task, int count);
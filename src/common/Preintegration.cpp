@@ -0,0 +1,82 @@
+#include <math.h>
+
+#include "Preintegration.h"
+#include "Parallel.h"
+
+// Linear interpolation in a table spread evenly over [0, 1]
+
+static inline float
+lookup(const float *t, int n, int stride, float x)
+{
+	float p = x * (n - 1);
+	int i = (int)p;
+	if (i >= n - 1)
+		return t[(n - 1) * stride];
+	float d = p - i;
+	return t[i * stride] + d * (t[(i + 1) * stride] - t[i * stride]);
+}
+
+// One task per back value
+
+class PreintegrationTask : public ParallelTask
+{
+public:
+	PreintegrationTask(const float *o, int no, const float *c, int nc, int sz, float *t) :
+		opacities(o), nOpacities(no), colors(c), nColors(nc), n(sz), table(t) {}
+
+	void run(int j, int count)
+	{
+		float back = j / (n - 1.0);
+
+		for (int i = 0; i < n; i++)
+		{
+			float front = i / (n - 1.0);
+
+			// Enough substeps to see every opacity table entry the segment crosses
+			int k = (int)ceilf(fabsf(back - front) * (nOpacities - 1)) + 1;
+
+			float r = 0, g = 0, b = 0, a = 0;
+			for (int s = 0; s < k && a < 0.9999; s++)
+			{
+				float x = front + ((s + 0.5) / k) * (back - front);
+
+				float o = lookup(opacities, nOpacities, 1, x);
+				o = o < 0 ? 0 : o > 1 ? 1 : o;
+				o = 1 - powf(1 - o, 1.0 / k);
+
+				float w = (1 - a) * o;
+				r += w * lookup(colors + 0, nColors, 3, x);
+				g += w * lookup(colors + 1, nColors, 3, x);
+				b += w * lookup(colors + 2, nColors, 3, x);
+				a += w;
+			}
+
+			float *e = table + 4 * (i + (size_t)n * j);
+			e[0] = r;
+			e[1] = g;
+			e[2] = b;
+			e[3] = a;
+		}
+	}
+
+private:
+	const float *opacities;
+	int nOpacities;
+	const float *colors;
+	int nColors;
+	int n;
+	float *table;
+};
+
+bool
+Preintegrate(const float *opacities, int nOpacities, const float *colors, int nColors, int n, std::vector<float>& table)
+{
+	if (nOpacities < 1 || nColors < 1 || n < 2)
+		return false;
+
+	table.resize(4 * (size_t)n * n);
+
+	PreintegrationTask task(opacities, nOpacities, colors, nColors, n, &table[0]);
+	ParallelRun(task, n);
+	return true;
+}
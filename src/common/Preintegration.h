@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+
+// Preintegrated transfer function table.  Entry (i, j) is the RGBA, with
+// colour premultiplied by opacity, of a ray segment one sampling step
+// long along which the value goes linearly from table value i (front)
+// to table value j (back).  Table values are n evenly spaced points
+// across the transfer function's value range; the entry for (i, j) is at
+// table[4*(i + n*j)].
+//
+// opacities and colors (rgb triples) are spread evenly across the value
+// range as OSPRay's piecewise linear transfer function does, and an
+// opacity is taken to be that of one sampling step.  Returns false if
+// there is nothing to integrate.
+
+bool Preintegrate(const float *opacities, int nOpacities, const float *colors, int nColors, int n, std::vector<float>& table);
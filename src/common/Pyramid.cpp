@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+
+#include "Pyramid.h"
+#include "Parallel.h"
+
+static int
+half(int n)
+{
+	return (n + 1) / 2;
+}
+
+void
+PyramidLevel(int x, int y, int z, int& nx, int& ny, int& nz, float spacing[3])
+{
+	int n[3] = { x, y, z }, h[3];
+	for (int k = 0; k < 3; k++)
+	{
+		h[k] = half(n[k]);
+		spacing[k] = h[k] > 1 ? (float)(n[k] - 1) / (h[k] - 1) : 1.0f;
+	}
+	nx = h[0]; ny = h[1]; nz = h[2];
+}
+
+int
+PyramidDepth(int x, int y, int z, size_t target, int max)
+{
+	int d = 0;
+	while (d < max && ((size_t)x)*y*z > target && half(x) >= 8 && half(y) >= 8 && half(z) >= 8)
+	{
+		x = half(x); y = half(y); z = half(z);
+		d++;
+	}
+	return d;
+}
+
+// Tent filter taps along one axis: coarse voxel i takes fine voxels
+// first[i] .. first[i] + count[i] - 1 with weights w[i*taps ...]
+
+struct Taps
+{
+	Taps(int n, int h)
+	{
+		float s = h > 1 ? (float)(n - 1) / (h - 1) : 1.0f;
+		taps = (int)ceilf(2*s) + 1;
+		first.resize(h);
+		count.resize(h);
+		w.assign(h * taps, 0.0f);
+
+		for (int i = 0; i < h; i++)
+		{
+			float c = i * s;
+			int lo = (int)ceilf(c - s), hi = (int)floorf(c + s);
+			if (lo < 0) lo = 0;
+			if (hi > n - 1) hi = n - 1;
+
+			float sum = 0;
+			first[i] = lo;
+			count[i] = 0;
+			for (int k = lo; k <= hi && count[i] < taps; k++)
+			{
+				float t = 1.0f - fabsf(k - c) / s;
+				if (t < 0) t = 0;
+				w[i*taps + count[i]++] = t;
+				sum += t;
+			}
+
+			for (int k = 0; k < count[i]; k++)
+				w[i*taps + k] = sum > 0 ? w[i*taps + k] / sum : 1.0f / count[i];
+		}
+	}
+
+	int									taps;
+	std::vector<int>		first, count;
+	std::vector<float>	w;
+};
+
+template<typename T> static T to_voxel(float v) { return (T)floorf(v + 0.5f); }
+template<> float to_voxel<float>(float v) { return v; }
+
+// One task per coarse z plane
+
+template<typename T>
+class DownsampleTask : public ParallelTask
+{
+public:
+	DownsampleTask(const T *s, T *d, int _x, int _y, int _z, int _nx, int _ny, int _nz) :
+		src(s), dst(d), x(_x), y(_y), z(_z), nx(_nx), ny(_ny), nz(_nz),
+		tx(_x, _nx), ty(_y, _ny), tz(_z, _nz) {}
+
+	void run(int k, int count)
+	{
+		std::vector<float> row(x);
+
+		for (int j = 0; j < ny; j++)
+		{
+			// Filter in z and y down to one row of x, then in x
+
+			row.assign(x, 0.0f);
+			for (int c = 0; c < tz.count[k]; c++)
+				for (int b = 0; b < ty.count[j]; b++)
+				{
+					float wzy = tz.w[k*tz.taps + c] * ty.w[j*ty.taps + b];
+					const T *s = src + (size_t)x * ((ty.first[j] + b) + (size_t)y * (tz.first[k] + c));
+					for (int i = 0; i < x; i++)
+						row[i] += wzy * s[i];
+				}
+
+			T *d = dst + (size_t)nx * (j + (size_t)ny * k);
+			for (int i = 0; i < nx; i++)
+			{
+				float v = 0;
+				for (int a = 0; a < tx.count[i]; a++)
+					v += tx.w[i*tx.taps + a] * row[tx.first[i] + a];
+				d[i] = to_voxel<T>(v);
+			}
+		}
+	}
+
+	const T	*src;
+	T				*dst;
+	int			x, y, z, nx, ny, nz;
+	Taps		tx, ty, tz;
+};
+
+template<typename T>
+static void *
+downsample(const T *v, int x, int y, int z, int& nx, int& ny, int& nz)
+{
+	float spacing[3];
+	PyramidLevel(x, y, z, nx, ny, nz, spacing);
+
+	T *d = (T *)malloc(((size_t)nx) * ny * nz * sizeof(T));
+	if (! d)
+		return NULL;
+
+	DownsampleTask<T> task(v, d, x, y, z, nx, ny, nz);
+	ParallelRun(task, nz);
+	return (void *)d;
+}
+
+void *
+Downsample(const void *voxels, const std::string& type, int x, int y, int z, int& nx, int& ny, int& nz)
+{
+	if (type == "float")
+		return downsample((const float *)voxels, x, y, z, nx, ny, nz);
+	else if (type == "uchar")
+		return downsample((const unsigned char *)voxels, x, y, z, nx, ny, nz);
+	else if (type == "ushort")
+		return downsample((const unsigned short *)voxels, x, y, z, nx, ny, nz);
+	else if (type == "short")
+		return downsample((const short *)voxels, x, y, z, nx, ny, nz);
+	else
+		return NULL;
+}
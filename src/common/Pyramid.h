@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+// Downsampling for volume pyramids.  A level has (n + 1) / 2 voxels
+// along each axis of n, spread over the same extent, so with a grid
+// spacing of (n - 1) / (n' - 1) it renders in the same place as the
+// level above.  Each voxel is a tent-filtered average of the finer
+// voxels within one coarse spacing of it.
+
+// Dimensions and grid spacing of the level below x, y, z
+
+void PyramidLevel(int x, int y, int z, int& nx, int& ny, int& nz, float spacing[3]);
+
+// Number of levels below full resolution needed to bring the voxel
+// count down to target, at most max, stopping before any axis gets
+// shorter than 8 voxels
+
+int PyramidDepth(int x, int y, int z, size_t target, int max);
+
+// Returns a malloc'ed level below voxels, of the same type, built in
+// parallel.  NULL if the type isn't supported.
+
+void *Downsample(const void *voxels, const std::string& type, int x, int y, int z, int& nx, int& ny, int& nz);
@@ -1,8 +1,9 @@
 #include <ospray/ospray.h>
 
 #include "RenderProperties.h"
+#include "Commits.h"
 
-RenderProperties::RenderProperties()
+RenderProperties::RenderProperties() : committed(false)
 {
 	ambient = 0.4;
 	n_samples = 0;
@@ -10,7 +11,7 @@ RenderProperties::RenderProperties()
 }
 
 void
-RenderProperties::setRenderer(OSPRenderer r) { renderer = r; }
+RenderProperties::setRenderer(OSPRenderer r) { renderer = r; committed = false; }
 
 void
 RenderProperties::loadState(Value& rp)
@@ -78,6 +79,18 @@ RenderProperties::setNumAOSamples(int n) { n_samples = n; }
 void
 RenderProperties::commit()
 {
+	if (committed && ambient == committedAmbient && radius == committedRadius && n_samples == committedSamples)
+	{
+		CountCommit(COMMIT_RENDERPROPERTIES, false);
+		return;
+	}
+
+	committed = true;
+	committedAmbient = ambient;
+	committedRadius = radius;
+	committedSamples = n_samples;
+	CountCommit(COMMIT_RENDERPROPERTIES, true);
+
 	ospSet1i(renderer, "AO number", getNumAOSamples());
 	ospSet1f(renderer, "AO radius", getAORadius());
 	ospSet1f(renderer, "ambient", getAmbient());
@@ -24,6 +24,10 @@ private:
 	int   n_samples;
 
 	OSPRenderer renderer;
+
+	bool  committed;
+	float committedAmbient, committedRadius;
+	int   committedSamples;
 };
 	
 
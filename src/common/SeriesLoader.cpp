@@ -0,0 +1,189 @@
+#include <iostream>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "SeriesLoader.h"
+
+SeriesLoader::SeriesLoader(const std::vector<std::string>& n, int nthreads) :
+		names(n), state(n.size(), IDLE), loaded(n.size()), quit(false)
+{
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&work, NULL);
+	pthread_cond_init(&done, NULL);
+
+	for (int i = 0; i < nthreads; i++)
+	{
+		pthread_t t;
+		if (pthread_create(&t, NULL, worker, (void *)this) == 0)
+			threads.push_back(t);
+	}
+
+	if (threads.empty())
+	{
+		std::cerr << "unable to start series loader threads\n";
+		exit(1);
+	}
+}
+
+SeriesLoader::~SeriesLoader()
+{
+	pthread_mutex_lock(&lock);
+	quit = true;
+	pthread_cond_broadcast(&work);
+	pthread_mutex_unlock(&lock);
+
+	for (size_t i = 0; i < threads.size(); i++)
+		pthread_join(threads[i], NULL);
+
+	for (size_t i = 0; i < loaded.size(); i++)
+		if (state[i] == READY)
+			loaded[i].Free();
+
+	pthread_cond_destroy(&work);
+	pthread_cond_destroy(&done);
+	pthread_mutex_destroy(&lock);
+}
+
+bool
+SeriesLoader::wanted(int i)
+{
+	return std::find(want.begin(), want.end(), i) != want.end();
+}
+
+// Drop a taken member from want, if it's still there
+
+void
+SeriesLoader::unwant(int i)
+{
+	std::vector<int>::iterator w = std::find(want.begin(), want.end(), i);
+	if (w != want.end())
+		want.erase(w);
+}
+
+void
+SeriesLoader::Want(const std::vector<int>& members)
+{
+	pthread_mutex_lock(&lock);
+
+	want = members;
+
+	for (size_t i = 0; i < state.size(); i++)
+		if (state[i] == READY && ! wanted(i))
+		{
+			loaded[i].Free();
+			state[i] = IDLE;
+		}
+		else if (state[i] == FAILED && ! wanted(i))
+			state[i] = IDLE;
+
+	pthread_cond_broadcast(&work);
+	pthread_mutex_unlock(&lock);
+}
+
+bool
+SeriesLoader::Take(int i, VolumeData& d)
+{
+	pthread_mutex_lock(&lock);
+
+	while (state[i] != READY)
+	{
+		if (state[i] == FAILED)
+		{
+			std::cerr << "unable to load series member " << i << " (" << names[i] << ")\n";
+			state[i] = IDLE;
+			unwant(i);
+			pthread_mutex_unlock(&lock);
+			return false;
+		}
+		if (state[i] == IDLE && ! wanted(i))
+		{
+			std::cerr << "series member " << i << " was never requested\n";
+			exit(1);
+		}
+		pthread_cond_wait(&done, &lock);
+	}
+
+	d = loaded[i];
+	loaded[i] = VolumeData();
+	state[i] = IDLE;
+	unwant(i);
+
+	pthread_mutex_unlock(&lock);
+	return true;
+}
+
+bool
+SeriesLoader::TakeReady(int& i, VolumeData& d)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&lock);
+
+	for (size_t j = 0; !found && j < state.size(); j++)
+		if (state[j] == READY)
+		{
+			i = j;
+			d = loaded[j];
+			loaded[j] = VolumeData();
+			state[j] = IDLE;
+			unwant(i);
+			found = true;
+		}
+
+	pthread_mutex_unlock(&lock);
+	return found;
+}
+
+void *
+SeriesLoader::worker(void *p)
+{
+	((SeriesLoader *)p)->run();
+	return NULL;
+}
+
+void
+SeriesLoader::run()
+{
+	pthread_mutex_lock(&lock);
+
+	while (! quit)
+	{
+		int i = -1;
+		for (size_t j = 0; i == -1 && j < want.size(); j++)
+			if (state[want[j]] == IDLE)
+				i = want[j];
+
+		if (i == -1)
+		{
+			pthread_cond_wait(&work, &lock);
+			continue;
+		}
+
+		state[i] = LOADING;
+		pthread_mutex_unlock(&lock);
+
+		// A failure is left for Take to report on the owner's thread
+
+		VolumeData d;
+		bool ok = Volume::Load(names[i], d);
+
+		pthread_mutex_lock(&lock);
+
+		if (! ok)
+			state[i] = wanted(i) ? FAILED : IDLE;
+		else if (wanted(i))
+		{
+			loaded[i] = d;
+			state[i] = READY;
+		}
+		else
+		{
+			d.Free();
+			state[i] = IDLE;
+		}
+
+		pthread_cond_broadcast(&done);
+	}
+
+	pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "Volume.h"
+
+// A pool of I/O threads that read the members of a volume series in the
+// background.  The owner says which members it wants, in priority
+// order, and collects the loaded data on its own thread to hand to
+// OSPRay.  Workers only ever call Volume::Load; a member that fails to
+// load is reported when the owner takes it.
+
+class SeriesLoader
+{
+public:
+		SeriesLoader(const std::vector<std::string>& names, int nthreads);
+		~SeriesLoader();
+
+		// Replace the wanted list.  Finished members that are no longer
+		// wanted are freed; loads in progress finish and are then dropped.
+		// Members that failed and are no longer wanted may be tried again.
+
+		void Want(const std::vector<int>& members);
+
+		// Block until member i (which must be wanted) is loaded and take
+		// its data; false if it couldn't be loaded
+
+		bool Take(int i, VolumeData& d);
+
+		// Take any member that has finished loading, without blocking
+
+		bool TakeReady(int& i, VolumeData& d);
+
+private:
+		static void *worker(void *);
+		void run();
+		bool wanted(int i);
+		void unwant(int i);
+
+		enum { IDLE, LOADING, READY, FAILED };
+
+		std::vector<std::string>	names;
+		std::vector<char>					state;
+		std::vector<VolumeData>		loaded;
+		std::vector<int>					want;
+
+		bool 											quit;
+		std::vector<pthread_t>		threads;
+		pthread_mutex_t						lock;
+		pthread_cond_t						work, done;
+};
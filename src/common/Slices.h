@@ -5,9 +5,12 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <string.h>
 #include <ospray/ospray.h>
 
 #include "common.h"
+#include "Commits.h"
+#include "Trace.h"
 
 #include "Volume.h"
 
@@ -16,7 +19,7 @@ using namespace std;
 class Slices {
 public:
 
-  Slices()
+  Slices() : committedRenderer(NULL), committedK(0)
 	{
 		for (int i = 0; i < 3; i++)
 		{
@@ -26,6 +29,19 @@ public:
 		}
 	}
 
+	// Take s's planes, but not its record of what was last committed
+	void CopySettings(Slices& s)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			values[i]     = s.values[i];
+			clips[i]      = s.clips[i];
+			onoffs[i]     = s.onoffs[i];
+			flips[i]      = s.flips[i];
+			visibility[i] = s.visibility[i];
+		}
+	}
+
 	void  SetValue(int i, int v)   { values[i] = v / 100.0; if (values[i] == 0.0) values[i] = -0.0001; else if (values[i] == 1.0) values[i] = 1.0001; }
 	void  SetValue(int i, float v) { values[i] = v; if (values[i] == 0.0) values[i] = -0.0001; else if (values[i] == 1.0) values[i] = 1.0001; }
 	float GetValue(int i) { return values[i]; }
@@ -64,12 +80,66 @@ public:
 		section.AddMember("Slices", a, doc.GetAllocator());
 	}
 
-	void commit(OSPRenderer& renderer, Volume *volume)
+	// Returns false without touching the renderer if it already has
+	// these planes
+
+	bool commit(OSPRenderer& renderer, Volume *volume)
 	{
+		TraceScope trace(TRACE_SLICES_COMMIT);
+
 		float planes[12];
 		int   visible[3];
 		int   clip[3];
 
+		int k = getPlanes(volume, planes, visible, clip);
+
+		if (renderer == committedRenderer && k == committedK &&
+				! memcmp(planes, committedPlanes, k*4*sizeof(float)) &&
+				! memcmp(visible, committedVisible, k*sizeof(int)) &&
+				! memcmp(clip, committedClip, k*sizeof(int)))
+		{
+			CountCommit(COMMIT_SLICES, false);
+			return false;
+		}
+
+		setData(renderer, "nslices", ospNewData(1, OSP_INT, &k));
+		if (k)
+		{
+			setData(renderer, "slice planes", ospNewData(k, OSP_FLOAT4, planes));
+			setData(renderer, "slice visibility", ospNewData(k, OSP_INT, visible));
+			setData(renderer, "slice clips", ospNewData(k, OSP_INT, clip));
+		}
+
+		committedRenderer = renderer;
+		committedK = k;
+		memcpy(committedPlanes, planes, sizeof(planes));
+		memcpy(committedVisible, visible, sizeof(visible));
+		memcpy(committedClip, clip, sizeof(clip));
+
+		CountCommit(COMMIT_SLICES, true);
+		return true;
+  }
+
+	// The clipping planes only, as (nx, ny, nz, d) keeping n.p + d <= 0;
+	// returns how many
+
+	int getClipPlanes(Volume *volume, float planes[12])
+	{
+		float all[12];
+		int   visible[3];
+		int   clip[3];
+
+		int k = getPlanes(volume, all, visible, clip), n = 0;
+		for (int i = 0; i < k; i++)
+			if (clip[i])
+				memcpy(planes + 4*n++, all + 4*i, 4*sizeof(float));
+		return n;
+	}
+
+private:
+	// The planes handed to the renderer, with their visibility and clip flags
+	int getPlanes(Volume *volume, float planes[12], int visible[3], int clip[3])
+	{
 		int xyz[3];
 		volume->GetDimensions(xyz[0], xyz[1], xyz[2]);
 
@@ -97,16 +167,22 @@ public:
 				k++;
 			}
 
-		ospSetData(renderer, "nslices", ospNewData(1, OSP_INT, &k));
-		if (k)
-		{
-			ospSetData(renderer, "slice planes", ospNewData(k, OSP_FLOAT4, planes));
-			ospSetData(renderer, "slice visibility", ospNewData(k, OSP_INT, visible));
-			ospSetData(renderer, "slice clips", ospNewData(k, OSP_INT, clip));
-		}
-  }
+		return k;
+	}
+
+	// The renderer holds its own reference to the data
+	static void setData(OSPRenderer r, const char *name, OSPData d)
+	{
+		ospSetData(r, name, d);
+		ospRelease(d);
+	}
+
+	OSPRenderer committedRenderer;
+	int   committedK;
+	float committedPlanes[12];
+	int   committedVisible[3];
+	int   committedClip[3];
 
-private:
 	float clips[3];
 	float values[3];
 	int   onoffs[3];
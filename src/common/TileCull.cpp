@@ -0,0 +1,136 @@
+#include <vector>
+#include <math.h>
+#include <ospray/ospray.h>
+
+#include "TileCull.h"
+#include "Camera.h"
+
+// OSPRay's TILE_SIZE; only used for the counts
+
+#define CULL_TILE_SIZE 64
+
+typedef std::vector<osp::vec3f> Polygon;
+
+static inline float
+side(const float *plane, const osp::vec3f& p)
+{
+	return plane[0]*p.x + plane[1]*p.y + plane[2]*p.z + plane[3];
+}
+
+// Keep the part of polygon with side <= 0
+
+static Polygon
+clip(const Polygon& polygon, const float *plane)
+{
+	Polygon out;
+	for (size_t i = 0; i < polygon.size(); i++)
+	{
+		const osp::vec3f& a = polygon[i];
+		const osp::vec3f& b = polygon[(i + 1) % polygon.size()];
+		float sa = side(plane, a), sb = side(plane, b);
+
+		if (sa <= 0)
+			out.push_back(a);
+		if ((sa < 0 && sb > 0) || (sa > 0 && sb < 0))
+			out.push_back(a + (sa / (sa - sb)) * (b - a));
+	}
+	return out;
+}
+
+// The region is convex, so its projection is bounded by the projections
+// of its vertices.  Every vertex lies on a face, and each face is a big
+// square on one of the planes clipped by all the others.
+
+bool
+ScreenBounds(Camera& camera, int x, int y, int z, const float *planes, int nPlanes, float bounds[4])
+{
+	std::vector<float> all(4 * (6 + nPlanes));
+	float box[6][4] =
+	{
+		{-1,  0,  0, 0}, {1, 0, 0, -(float)(x - 1)},
+		{ 0, -1,  0, 0}, {0, 1, 0, -(float)(y - 1)},
+		{ 0,  0, -1, 0}, {0, 0, 1, -(float)(z - 1)}
+	};
+	for (int i = 0; i < 6; i++)
+		for (int j = 0; j < 4; j++)
+			all[4*i + j] = box[i][j];
+	for (int i = 0; i < 4 * nPlanes; i++)
+		all[24 + i] = planes[i];
+
+	osp::vec3f center((x - 1) / 2.0, (y - 1) / 2.0, (z - 1) / 2.0);
+	float size = 2 * (x + y + z);
+
+	bounds[0] = bounds[1] = 1e30;
+	bounds[2] = bounds[3] = -1e30;
+
+	for (int i = 0; i < 6 + nPlanes; i++)
+	{
+		const float *p = &all[4*i];
+		osp::vec3f n(p[0], p[1], p[2]);
+		float l = sqrt(dot(n, n));
+		if (l == 0)
+			continue;
+		n = (1 / l) * n;
+
+		// Square centred on the box centre's projection onto the plane
+		osp::vec3f o = center - (side(p, center) / l) * n;
+		osp::vec3f u = cross(n, fabs(n.x) < 0.9 ? osp::vec3f(1, 0, 0) : osp::vec3f(0, 1, 0));
+		u = size * normalize(u);
+		osp::vec3f v = cross(n, u);
+
+		Polygon face;
+		face.push_back(o - u - v);
+		face.push_back(o + u - v);
+		face.push_back(o + u + v);
+		face.push_back(o - u + v);
+
+		for (int j = 0; j < 6 + nPlanes && face.size(); j++)
+			if (j != i)
+				face = clip(face, &all[4*j]);
+
+		for (size_t k = 0; k < face.size(); k++)
+		{
+			float sx, sy;
+			if (! camera.project(face[k], sx, sy))
+				return false;
+
+			bounds[0] = sx < bounds[0] ? sx : bounds[0];
+			bounds[1] = sy < bounds[1] ? sy : bounds[1];
+			bounds[2] = sx > bounds[2] ? sx : bounds[2];
+			bounds[3] = sy > bounds[3] ? sy : bounds[3];
+		}
+	}
+
+	return true;
+}
+
+static long tiles, culled;
+
+void
+CountCulledTiles(int w, int h, bool bounded, const float bounds[4])
+{
+	int nx = (w + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE;
+	int ny = (h + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE;
+	long n = 0;
+
+	// Same test as the renderer: a tile is skipped if none of its pixel
+	// centres is within the bounds
+	if (bounded)
+		for (int j = 0; j < ny; j++)
+			for (int i = 0; i < nx; i++)
+			{
+				float x0 = (i * CULL_TILE_SIZE + 0.5) / w, x1 = ((i + 1) * CULL_TILE_SIZE - 0.5) / w;
+				float y0 = (j * CULL_TILE_SIZE + 0.5) / h, y1 = ((j + 1) * CULL_TILE_SIZE - 0.5) / h;
+				if (x1 < bounds[0] || x0 > bounds[2] || y1 < bounds[1] || y0 > bounds[3])
+					n++;
+			}
+
+	__sync_fetch_and_add(&tiles, (long)nx * ny);
+	__sync_fetch_and_add(&culled, n);
+}
+
+void
+ReportCulledTiles(std::ostream& o)
+{
+	o << "tiles culled: " << culled << " of " << tiles << "\n";
+}
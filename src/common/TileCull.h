@@ -0,0 +1,24 @@
+#pragma once
+
+#include <iostream>
+
+class Camera;
+
+// Screen-space bounds of what a volume can contribute to an image, so the
+// renderer can skip tiles outside them.  The region is the volume's box
+// (0 .. dimensions-1 in world space) cut by the clip planes, each
+// (nx, ny, nz, d) keeping n.p + d <= 0, as Slices hands them to the
+// renderer.
+//
+// bounds is (x0, y0, x1, y1) in the camera's [0, 1] screen coordinates.
+// Returns false if the region can't be bounded (part of it is behind the
+// camera) and the whole image has to be rendered; an empty region gives
+// x0 > x1.
+
+bool ScreenBounds(Camera& camera, int x, int y, int z, const float *planes, int nPlanes, float bounds[4]);
+
+// Tally the tiles of a w x h image the renderer will skip with these
+// bounds (bounded false: none), and report the totals
+
+void CountCulledTiles(int w, int h, bool bounded, const float bounds[4]);
+void ReportCulledTiles(std::ostream& o);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <sys/time.h>
+
+// Wall clock time in seconds
+
+static inline double
+WallClock()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
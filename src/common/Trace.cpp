@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <iomanip>
+#include <vector>
+
+#include "Trace.h"
+
+static const char *names[N_TRACE_STAGES] =
+{
+	"volume commit", "slices commit", "isosurfaces commit", "camera commit",
+	"transfer function commit", "renderer commit", "render frame",
+	"map framebuffer", "pixel fixup", "png encode", "metadata", "state file",
+	"volume load", "sim generate", "sim dump"
+};
+
+static long			calls[N_TRACE_STAGES];
+static uint64_t	total[N_TRACE_STAGES];
+static uint64_t	longest[N_TRACE_STAGES];
+
+// Events recorded by one thread.  Buffers outlive their threads (the
+// encoder threads come and go) and are only read once tracing is done.
+
+struct TraceEvent
+{
+	int				stage;
+	uint64_t	start, duration;
+};
+
+struct TraceBuffer
+{
+	int												tid;
+	std::vector<TraceEvent>		events;
+};
+
+static pthread_mutex_t						bufferLock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<TraceBuffer *>	buffers;
+static __thread TraceBuffer			 *myBuffer = NULL;
+
+static const char *traceFile = getenv("VOLVIEWER_TRACE");
+static bool written = false;
+
+static void writeAtExit() { WriteTrace(); }
+static int registered = traceFile ? atexit(writeAtExit) : 0;
+
+uint64_t
+TraceClock()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void
+TraceEnd(TraceStage stage, uint64_t t0)
+{
+	uint64_t d = TraceClock() - t0;
+
+	__sync_fetch_and_add(&calls[stage], 1);
+	__sync_fetch_and_add(&total[stage], d);
+
+	uint64_t l = longest[stage];
+	while (d > l && ! __sync_bool_compare_and_swap(&longest[stage], l, d))
+		l = longest[stage];
+
+	if (! traceFile)
+		return;
+
+	if (! myBuffer)
+	{
+		myBuffer = new TraceBuffer;
+		pthread_mutex_lock(&bufferLock);
+		myBuffer->tid = buffers.size();
+		buffers.push_back(myBuffer);
+		pthread_mutex_unlock(&bufferLock);
+	}
+
+	TraceEvent e;
+	e.stage = stage;
+	e.start = t0;
+	e.duration = d;
+	myBuffer->events.push_back(e);
+}
+
+void
+ReportTrace(std::ostream& o)
+{
+	o << "stages:                         calls    total s     mean ms      max ms\n";
+	for (int i = 0; i < N_TRACE_STAGES; i++)
+	{
+		if (! calls[i])
+			continue;
+
+		o << "  " << std::left << std::setw(26) << names[i] << std::right
+			<< std::setw(9) << calls[i]
+			<< std::fixed << std::setprecision(3)
+			<< std::setw(11) << total[i] / 1e6
+			<< std::setw(12) << total[i] / 1e3 / calls[i]
+			<< std::setw(12) << longest[i] / 1e3 << "\n";
+		o.unsetf(std::ios_base::floatfield);
+	}
+}
+
+void
+WriteTrace()
+{
+	if (! traceFile || written)
+		return;
+
+	FILE *f = fopen(traceFile, "w");
+	if (! f)
+	{
+		std::cerr << "unable to write trace " << traceFile << "\n";
+		return;
+	}
+
+	int pid = getpid();
+	bool first = true;
+
+	fprintf(f, "{\"traceEvents\": [\n");
+
+	pthread_mutex_lock(&bufferLock);
+	for (size_t b = 0; b < buffers.size(); b++)
+		for (size_t i = 0; i < buffers[b]->events.size(); i++)
+		{
+			TraceEvent& e = buffers[b]->events[i];
+			fprintf(f, "%s{\"name\": \"%s\", \"cat\": \"volviewer\", \"ph\": \"X\", \"ts\": %llu, \"dur\": %llu, \"pid\": %d, \"tid\": %d}",
+				first ? "" : ",\n", names[e.stage], (unsigned long long)e.start, (unsigned long long)e.duration,
+				pid, buffers[b]->tid);
+			first = false;
+		}
+	pthread_mutex_unlock(&bufferLock);
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+
+	written = true;
+	std::cerr << "trace written to " << traceFile << "\n";
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <iostream>
+#include <stdint.h>
+
+// Time spent in each stage of rendering a frame.  A TraceScope times
+// the block it lives in:
+//
+//		{
+//			TraceScope t(TRACE_PNG_ENCODE);
+//			write_png(...);
+//		}
+//
+// Calls, total and longest time per stage are always tallied (two clock
+// reads and a few atomic adds a scope); ReportTrace prints them.  With
+// VOLVIEWER_TRACE set to a file name every scope is also recorded, per
+// thread, and written there at exit as Chrome trace events (load it in
+// chrome://tracing or Perfetto).
+
+enum TraceStage
+{
+	TRACE_VOLUME_COMMIT,
+	TRACE_SLICES_COMMIT,
+	TRACE_ISOS_COMMIT,
+	TRACE_CAMERA_COMMIT,
+	TRACE_TRANSFERFUNCTION_COMMIT,
+	TRACE_RENDERER_COMMIT,
+	TRACE_RENDER_FRAME,
+	TRACE_MAP_FRAMEBUFFER,
+	TRACE_PIXEL_FIXUP,
+	TRACE_PNG_ENCODE,
+	TRACE_METADATA,
+	TRACE_STATE_FILE,
+	TRACE_VOLUME_LOAD,
+	TRACE_SIM_GENERATE,
+	TRACE_SIM_DUMP,
+	N_TRACE_STAGES
+};
+
+// Monotonic time in microseconds
+uint64_t TraceClock();
+
+// Account for a stage that started at t0 and ends now
+void TraceEnd(TraceStage stage, uint64_t t0);
+
+class TraceScope
+{
+public:
+	TraceScope(TraceStage s) : stage(s), t0(TraceClock()) {}
+	~TraceScope() { TraceEnd(stage, t0); }
+
+private:
+	TraceStage	stage;
+	uint64_t		t0;
+};
+
+// Calls, total, mean and longest time of each stage that ran
+void ReportTrace(std::ostream& o);
+
+// Write the recorded events now rather than at exit (does nothing
+// unless VOLVIEWER_TRACE is set)
+void WriteTrace();
@@ -5,6 +5,9 @@
 #include <dirent.h>
 #include "ospray/ospray.h"
 #include "TransferFunction.h"
+#include "Commits.h"
+#include "Trace.h"
+#include "Preintegration.h"
 
 using namespace std;
 
@@ -61,9 +64,46 @@ load_colormap_directory()
   return colormaps;
 }
 
+bool
+TransferFunction::unchanged(OSPRenderer r)
+{
+	if (r != committedRenderer || minv != committedMin || maxv != committedMax || scale != committedScale ||
+			doVolumeRendering != committedDoVolumeRendering || preintegration != committedPreintegration ||
+			colors.size() != committedColors.size() || alphas.size() != committedAlphas.size())
+		return false;
+
+	for (int i = 0; i < colors.size(); i++)
+		if (colors[i].x != committedColors[i].x || colors[i].y != committedColors[i].y || colors[i].z != committedColors[i].z)
+			return false;
+
+	for (int i = 0; i < alphas.size(); i++)
+		if (alphas[i].x != committedAlphas[i].x || alphas[i].y != committedAlphas[i].y)
+			return false;
+
+	return true;
+}
+
 void
 TransferFunction::commit(OSPRenderer& r)
 {
+	TraceScope trace(TRACE_TRANSFERFUNCTION_COMMIT);
+
+	if (unchanged(r))
+	{
+		CountCommit(COMMIT_TRANSFERFUNCTION, false);
+		return;
+	}
+
+	committedRenderer = r;
+	committedMin = minv;
+	committedMax = maxv;
+	committedScale = scale;
+	committedDoVolumeRendering = doVolumeRendering;
+	committedPreintegration = preintegration;
+	committedColors = colors;
+	committedAlphas = alphas;
+	CountCommit(COMMIT_TRANSFERFUNCTION, true);
+
 	ospSet2f(tf, "valueRange", minv, maxv);
 
 	float xmin = alphas.front().x;
@@ -84,9 +124,22 @@ TransferFunction::commit(OSPRenderer& r)
 
 	OSPData oAlphas = ospNewData(interpolated.size(), OSP_FLOAT, interpolated.data());
 	ospSetData(tf, "opacities", oAlphas);
+	ospRelease(oAlphas);
 
 	OSPData oColors = ospNewData(colors.size(), OSP_FLOAT3, colors.data());
 	ospSetData(tf, "colors", oColors);
+	ospRelease(oColors);
+
+	vector<float> table;
+	if (preintegration > 1 && Preintegrate(interpolated.data(), interpolated.size(), (float *)colors.data(), colors.size(), preintegration, table))
+	{
+		OSPData oTable = ospNewData(table.size() / 4, OSP_FLOAT4, table.data());
+		ospSetData(tf, "preintegrated", oTable);
+		ospRelease(oTable);
+		ospSet1i(tf, "preintegrationSize", preintegration);
+	}
+	else
+		ospSet1i(tf, "preintegrationSize", 0);
 
 
 	ospSet1i(r, "doVolumeRendering", doVolumeRendering ? 1 : 0);
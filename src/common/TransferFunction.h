@@ -5,6 +5,7 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <stdlib.h>
 #include <ospray/ospray.h>
 
 #include "common.h"
@@ -18,7 +19,9 @@ public:
 		minv(0.0),
 		maxv(1.0),
 		scale(1.0),
-		doVolumeRendering(true)
+		doVolumeRendering(true),
+		preintegration(getenv("VOLVIEWER_PREINTEGRATION") ? atoi(getenv("VOLVIEWER_PREINTEGRATION")) : 0),
+		committedRenderer(NULL)
 	{
 		alphas.push_back(osp::vec2f(0.0, 0.0));
 		alphas.push_back(osp::vec2f(1.0, 1.0));
@@ -37,6 +40,12 @@ public:
 	float GetScale() { return scale; }
 
 	void SetDoVolumeRendering(bool yesNo) { doVolumeRendering = yesNo; }
+	bool GetDoVolumeRendering() { return doVolumeRendering; }
+
+	// Resolution of the preintegrated (front, back) table the vis renderer
+	// uses in place of per-sample lookups; 0 for none
+	void SetPreintegration(int n) { preintegration = n; }
+	int GetPreintegration() { return preintegration; }
 
 	void SetAlphas(vector<osp::vec2f> a) { alphas = a; }
 	vector<osp::vec2f> GetAlphas() { return alphas; }
@@ -56,6 +65,9 @@ public:
 		SetScale((float)section["Scale"].GetDouble());
 		SetMin((float)section["Min"].GetDouble());
 		SetMax((float)section["Max"].GetDouble());
+
+		if (section.HasMember("Preintegration"))
+			SetPreintegration(section["Preintegration"].GetInt());
 	}
 
   void saveState(Document &doc, Value &section)
@@ -75,10 +87,12 @@ public:
 		tf.AddMember("Scale", Value().SetDouble((double)GetScale()), doc.GetAllocator());
 		tf.AddMember("Min", Value().SetDouble((double)GetMin()), doc.GetAllocator());
 		tf.AddMember("Max", Value().SetDouble((double)GetMax()), doc.GetAllocator());
+		tf.AddMember("Preintegration", Value().SetInt(GetPreintegration()), doc.GetAllocator());
 
 		section.AddMember("TransferFunction", tf, doc.GetAllocator());
 	}
 
+	// Does nothing if r and the transfer function already have this state
 	void commit(OSPRenderer& r);
 
 	void setColors(vector<osp::vec3f> c) 
@@ -96,9 +110,19 @@ public:
 private:
 	float       				minv, maxv, scale;
 	bool								doVolumeRendering;
+	int									preintegration;
 	vector<osp::vec3f>  colors;
 	vector<osp::vec2f> 	alphas;
 	OSPTransferFunction tf;
+
+	bool unchanged(OSPRenderer r);
+
+	OSPRenderer					committedRenderer;
+	float								committedMin, committedMax, committedScale;
+	bool								committedDoVolumeRendering;
+	int									committedPreintegration;
+	vector<osp::vec3f>  committedColors;
+	vector<osp::vec2f> 	committedAlphas;
 };
 
 vector<osp::vec3f> load_colormap(string fname);
@@ -7,8 +7,17 @@
 #include <vtkXMLDataParser.h>
 #include <vtkAbstractArray.h>
 #include <vtkDataArray.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "VTIReader.h"
+#include "Parallel.h"
+
+// Number of doubles read per ReadArrayValues call.  Two chunks are in
+// flight at once: one being read, one being converted.
+
+#define VTI_CHUNK (1 << 22)
 
 using namespace std;
 
@@ -87,6 +96,9 @@ VTIReader::GetInfo()
 		exit(1);
 	}
 
+	if (pdata->GetAttribute("Scalars"))
+		scalarsName = pdata->GetAttribute("Scalars");
+
 	for (int i = 0; i < pdata->GetNumberOfNestedElements(); i++)
 	{
 		vtkXMLDataElement *e = pdata->GetNestedElement(i);
@@ -103,6 +115,27 @@ VTIReader::GetInfo()
 			arrayNames.push_back(name);
 		}
 	}
+
+	// Only single-component arrays can be volume rendered.  If the active
+	// scalars are something else (a vector, say), fall back to the first
+	// array that can rather than fail the lookup later.
+
+	if (scalarsName.size())
+	{
+		bool found = false;
+		for (size_t i = 0; !found && i < arrayNames.size(); i++)
+			found = scalarsName == arrayNames[i];
+
+		if (! found)
+		{
+			cerr << "active scalars " << scalarsName << " are not a single-component array; ";
+			if (arrayNames.size())
+				cerr << "using " << arrayNames[0] << " instead\n";
+			else
+				cerr << "no other array to use\n";
+			scalarsName.clear();
+		}
+	}
 }
 
 void
@@ -116,6 +149,31 @@ VTIReader::ShowInfo()
 
 }
 
+class ConvertDoubles : public ParallelTask
+{
+public:
+	void run(int i, int count)
+	{
+		size_t s = (n * i) / count;
+		size_t e = (n * (i + 1)) / count;
+
+		for (size_t k = s; k < e; k++)
+			dst[k] = (float)src[k];
+	}
+
+	const double *src;
+	float				 *dst;
+	size_t				n;
+};
+
+static void *
+convert_chunk(void *p)
+{
+	ConvertDoubles *task = (ConvertDoubles *)p;
+	ParallelRun(*task, 4*ParallelThreadCount());
+	return NULL;
+}
+
 char *
 VTIReader::GetData(const char *name, const char*& type)
 {
@@ -133,12 +191,25 @@ VTIReader::GetData(const char *name, const char*& type)
 	size_t numTuples = counts[0]*counts[1]*counts[2];
 
 	vtkAbstractArray *ar = this->CreateArray(elt);
-	ar->SetNumberOfTuples(numTuples);
 
 	void *buffer = NULL;
 
-	if (ar->IsA("vtkFloatArray") || ar->IsA("vtkUnsignedCharArray"))
+	// Types OSPRay can sample are read as they are
+
+	const char *native = NULL;
+	if (ar->IsA("vtkFloatArray"))
+		native = "float";
+	else if (ar->IsA("vtkUnsignedCharArray"))
+		native = "uchar";
+	else if (ar->IsA("vtkUnsignedShortArray"))
+		native = "ushort";
+	else if (ar->IsA("vtkShortArray"))
+		native = "short";
+
+	if (native)
 	{
+		ar->SetNumberOfTuples(numTuples);
+
 		cerr << "trying to allocate " << (ar->GetElementComponentSize() * numTuples) << " bytes\n";
 
 		buffer = (void *)malloc(ar->GetElementComponentSize() * numTuples);
@@ -146,7 +217,7 @@ VTIReader::GetData(const char *name, const char*& type)
 
 		// Read directly into buffer
 
-		type = ar->IsA("vtkFloatArray") ? "float" : "uchar";
+		type = native;
 
 		vtkDataArray::SafeDownCast(ar)->SetVoidArray(buffer, ar->GetElementComponentSize() * numTuples, 1);
 	
@@ -161,18 +232,49 @@ VTIReader::GetData(const char *name, const char*& type)
 	{
 		type = "float";
 
-		if (! this->ReadArrayValues(elt, 0, ar, 0, numTuples))
+		buffer = (void *)malloc(sizeof(float) * numTuples);
+
+		// Read chunk k while the worker threads convert chunk k-1
+
+		vtkAbstractArray *chunk[2] = { ar, this->CreateArray(elt) };
+		chunk[0]->SetNumberOfTuples(VTI_CHUNK);
+		chunk[1]->SetNumberOfTuples(VTI_CHUNK);
+
+		ConvertDoubles task[2];
+		pthread_t converter;
+		bool converting = false;
+
+		int k = 0;
+		for (size_t start = 0; start < numTuples; start += VTI_CHUNK, k ^= 1)
 		{
-			std::cerr << "ReadArrayForValues error\n";
-			return NULL;
+			size_t n = (numTuples - start) < VTI_CHUNK ? (numTuples - start) : VTI_CHUNK;
+
+			if (! this->ReadArrayValues(elt, 0, chunk[k], start, n))
+			{
+				std::cerr << "ReadArrayForValues error\n";
+				if (converting)
+					pthread_join(converter, NULL);
+				converting = false;
+				free(buffer);
+				buffer = NULL;
+				break;
+			}
+
+			if (converting)
+				pthread_join(converter, NULL);
+
+			task[k].src  = (const double *)chunk[k]->GetVoidPointer(0);
+			task[k].dst  = (float *)buffer + start;
+			task[k].n    = n;
+			converting = pthread_create(&converter, NULL, convert_chunk, (void *)&task[k]) == 0;
+			if (! converting)
+				convert_chunk((void *)&task[k]);
 		}
 
-		buffer = (void *)malloc(sizeof(float) * numTuples);
+		if (converting)
+			pthread_join(converter, NULL);
 
-		double *src = (double *)ar->GetVoidPointer(0);
-		float *dst = (float *)buffer;
-		for (int i = 0; i < numTuples; i++)
-			*dst++ = *src++;
+		chunk[1]->Delete();
 	}
 	else
 		std::cerr << "unsupported data class: " << ar->GetClassName() << "\n";
@@ -19,8 +19,16 @@ public:
 
 	void GetInfo();
 	void ShowInfo();
+
+	// Returns a malloc'ed buffer holding the named array.  Arrays OSPRay
+	// can sample are read straight into it; doubles are streamed through
+	// in chunks and converted to float on the fly, so peak memory is
+	// about the size of the result.
 	char *GetData(const char *name, const char*& type);
 
+	// The active scalars of the PointData, or the first usable array
+	const char *GetScalarsName() { return scalarsName.size() ? scalarsName.c_str() : (arrayNames.size() ? arrayNames[0] : NULL); }
+
 	size_t *GetCounts() { return counts; }
 	float  *GetOrigin() { return origin; }
 	float  *GetDeltas() { return deltas; }
@@ -31,6 +39,7 @@ public:
 private:
 	vector<const char *> arrayNames;
 	vector<vtkXMLDataElement *> arrayElements;
+	string scalarsName;
 	size_t counts[3];
 	float  origin[3];
 	float  deltas[3];
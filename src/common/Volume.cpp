@@ -1,17 +1,33 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <vtkType.h>
 #include <vtkNew.h>
 #include <vtkImageData.h>
-#include <vtkXMLImageDataReader.h>
 #include "Volume.h"
 #include "TransferFunction.h"
+#include "VTIReader.h"
+#include "Camera.h"
+#include "BrickFile.h"
+#include "BrickCache.h"
+#include "SeriesLoader.h"
+#include "Commits.h"
+#include "Trace.h"
+#include "Macrocells.h"
+#include "VoxelType.h"
+#include "Pyramid.h"
 
 Volume::Volume() :
 		shared(false), nIso(0), isoValues(NULL),
-		voxels(NULL), mod(true), data(NULL),
-		type("none"), x(-1), ospv(NULL), imagedata(NULL)
+		voxels(NULL), mapped(NULL), mappedSize(0), shareSource(NULL), brickFile(NULL), brickCache(NULL), histogramEnabled(false), haveMinMax(false), mod(true), data(NULL),
+		type("none"), x(-1), samplingRate(1.0), ospv(NULL), imagedata(NULL)
 {
+	spacing[0] = spacing[1] = spacing[2] = 1.0;
 }
 
 void
@@ -29,13 +45,13 @@ Volume::Initialize(bool s)
 		data = NULL;
 	}
 
-	if (voxels) 
-	{
-		free(voxels); 
-		voxels = NULL; 
-	}
+	_freeVoxels();
+	_freePyramid();
 
+	spacing[0] = spacing[1] = spacing[2] = 1.0;
 	shared = s;
+	nIso = 0;
+	mod = true;
 	ospv = s ? ospNewVolume("shared_structured_volume") : ospNewVolume("block_bricked_volume");
 }
 
@@ -45,12 +61,26 @@ Volume::~Volume()
 
 	if (ospv) ospRelease(ospv); 
 	if (data) ospRelease(data); 
-	if (voxels) free(voxels); 
+	if (isoValues) delete[] isoValues;
+	_freeVoxels();
+	_freePyramid();
+}
+
+void
+Volume::_freeVoxels()
+{
+	if (shareSource) shareSource = NULL;
+	else if (brickCache) _closeBricks();
+	else if (mapped) _unmap();
+	else if (voxels) free(voxels); 
+	voxels = NULL;
 }
 
 void
 Volume::commit(bool commit_data)
 {
+	TraceScope trace(TRACE_VOLUME_COMMIT);
+
 	if (! ospv) 
 	{
 		std::cerr << "can't commit uninitialied volume\n";
@@ -62,7 +92,13 @@ Volume::commit(bool commit_data)
 	{
 		ospCommit(ospv);
 		mod = false;
+		CountCommit(COMMIT_VOLUME, true);
 	}
+	else
+		CountCommit(COMMIT_VOLUME, false);
+
+	for (size_t i = 0; i < pyramid.size(); i++)
+		pyramid[i]->commit();
 
 	if (commit_data)
 	{
@@ -100,6 +136,7 @@ Volume:: ResetMinMax()
 	}
 
 	_setMinMax(voxels);
+	_setMacrocells();
 }
 
 void
@@ -114,6 +151,11 @@ Volume:: GetDimensions(int& _x, int& _y, int& _z) {_x = x; _y = y; _z = z;}
 void
 Volume:: SetType(std::string _t)
 {		
+		if (! VoxelTypeNative(_t))
+		{
+			std::cerr << "unsupported voxel type: " << _t << "\n";
+			exit(1);
+		}
 		type = _t; mod = true; 
 		ospSetString(ospv, "voxelType", type.c_str());
 }
@@ -125,6 +167,9 @@ Volume:: SetSamplingRate(float _r)
 {
 		samplingRate = _r; mod = true; 
 		ospSet1f(ospv, "samplingRate", samplingRate);
+
+		for (size_t i = 0; i < pyramid.size(); i++)
+			pyramid[i]->SetSamplingRate(_r);
 }
 void
 Volume:: GetSamplingRate(float& _r) {_r = samplingRate;}
@@ -135,6 +180,9 @@ Volume:: SetTransferFunction(TransferFunction _tf)
 	if (! ospv)  return;
 	ospTransferFunction = _tf.getOSPTransferFunction(); mod = true; 
 	ospSetObject(ospv, "transferFunction", ospTransferFunction);
+
+	for (size_t i = 0; i < pyramid.size(); i++)
+		pyramid[i]->SetTransferFunction(_tf);
 }
 
 void
@@ -156,11 +204,20 @@ Volume:: SetVoxels(void*  _v)
 
 	if (shared)
 	{
+		// Point the existing volume at the new buffer; only the small
+		// data wrapper is replaced, the OSPRay volume itself is kept
+
+		OSPData old = data;
+
 		voxels = _v;
-		size_t k = x * y * z;
-		data = ospNewData(k, type == "float" ? OSP_FLOAT : OSP_UCHAR, voxels, OSP_DATA_SHARED_BUFFER);
+		size_t k = (size_t)x * y * z;
+		data = ospNewData(k, _ospType(), voxels, OSP_DATA_SHARED_BUFFER);
 		ospCommit(data);
 		ospSetObject(ospv, "voxelData", data);
+		if (old)
+			ospRelease(old);
+		_setMacrocells();
+		mod = true;
 	}
 	else
 		ospSetRegion(ospv, _v, osp::vec3i(0,0,0), osp::vec3i(x,y,z));
@@ -172,165 +229,623 @@ Volume:: GetVoxels(void*& _v) {_v = voxels;}
 void
 Volume:: GetMinMax(float& _m, float& _M) {_m = m; _M = M; }
 
-void
+bool
 Volume:: SetIsovalues(int n, float *v)
 {
-	if (! ospv) return;
+	if (! ospv) return false;
+
+	for (size_t i = 0; i < pyramid.size(); i++)
+		pyramid[i]->SetIsovalues(n, v);
+
+	// A new OSPRay volume starts with none, and nIso is reset to match
+
+	if (n == nIso && (n == 0 || ! memcmp(isoValues, v, n*sizeof(float))))
+	{
+		CountCommit(COMMIT_ISOS, false);
+		return false;
+	}
+
+	if (isoValues) delete[] isoValues;
+	isoValues = NULL;
 
 	if (n)
 	{
-		if (isoValues) delete[] isoValues;
 		isoValues = new float[n];
 		memcpy((void *)isoValues, (void *)v, n*sizeof(float));
-		ospSetData(ospv, "isovalues", ospNewData(nIso, OSP_FLOAT, isoValues));
+
+		OSPData d = ospNewData(n, OSP_FLOAT, isoValues);
+		ospSetData(ospv, "isovalues", d);
+		ospRelease(d);
 	}
 	else
 			ospSetData(ospv, "isovalues", NULL);
 	nIso = n;
 	mod = true;
+
+	CountCommit(COMMIT_ISOS, true);
+	return true;
+}
+
+// Per-cell value ranges, from which the renderer works out which cells
+// the transfer function leaves fully transparent and skips them.
+// VOLVIEWER_MACROCELL is the cell size in voxels (default 8, 0 to turn
+// skipping off).  Paged volumes take theirs from the brick file's
+// per-brick ranges, since scanning would read it all.
+
+static int
+macrocell_size()
+{
+	const char *e = getenv("VOLVIEWER_MACROCELL");
+	return e ? atoi(e) : 8;
+}
+
+void
+Volume::_setMacrocells()
+{
+	int size = macrocell_size();
+	if (! shared || ! voxels || size <= 0)
+		return;
+
+	if (shareSource)
+		macrocells = shareSource->macrocells;
+	else if (brickFile)
+	{
+		if (! brickFile->GetMacrocells(size, macrocells))
+			return;
+	}
+	else if (! ComputeMacrocells(voxels, type, x, y, z, size, macrocells))
+		return;
+
+	if (macrocells.empty())
+		return;
+
+	OSPData d = ospNewData(macrocells.size() / 2, OSP_FLOAT2, &macrocells[0]);
+	ospSetData(ospv, "macrocells", d);
+	ospRelease(d);
+	ospSet1i(ospv, "macrocellSize", size);
+	mod = true;
 }
 
 void
 Volume:: _setMinMax(void *v)
 {
-	if (type == "float")
+	// Scanning a paged volume would pull all of it in; the brick file
+	// carries its range
+
+	if (brickFile)
 	{
-		float *ptr = (float *)v;
-		m = *ptr;
-		M = *ptr;
-		size_t n = ((size_t)x)*((size_t)y)*((size_t)z);
-		for (size_t i = 0; i < n; i++, ptr++)
-		{
-			if (m > *ptr) m = *ptr;
-			if (M < *ptr) M = *ptr;
-		}
+		brickFile->GetMinMax(m, M);
+		return;
 	}
-	else
+
+	if (haveMinMax && ! histogramEnabled)
+	{
+		haveMinMax = false;
+		return;
+	}
+	haveMinMax = false;
+
+	size_t n = ((size_t)x)*((size_t)y)*((size_t)z);
+	ComputeMinMax(v, n, type, m, M, histogramEnabled ? &histogram : NULL);
+}
+
+OSPDataType
+Volume::_ospType()
+{
+	if (type == "uchar")  return OSP_UCHAR;
+	if (type == "short")  return OSP_SHORT;
+	if (type == "ushort") return OSP_USHORT;
+	return OSP_FLOAT;
+}
+
+// OSPRay can't sample half voxels, so they are widened to float as
+// they are loaded; the half buffer (or mapping) is released.
+
+void
+Volume::_widenHalf(VolumeData& d)
+{
+	size_t k = ((size_t)d.x) * d.y * d.z;
+	float *f = WidenHalf(d.voxels, k, d.mapped);
+	if (d.mapped)
+		munmap(d.voxels, d.size);
+
+	if (! f)
+	{
+		std::cerr << "unable to allocate " << k * sizeof(float) << " bytes for half volume\n";
+		exit(1);
+	}
+
+	d.voxels = (void *)f;
+	d.size = k * sizeof(float);
+	d.mapped = false;
+	d.type = "float";
+}
+
+// Map a raw voxel file read-only so it can be handed to a shared
+// volume without copying.  Returns false (and the caller falls back to
+// reading the file) if the file can't be mapped or is too short.
+// Setting VOLVIEWER_NO_MMAP in the environment disables mapping.
+
+bool
+Volume::_mapRaw(const std::string& fname, size_t sz, void*& v)
+{
+	if (getenv("VOLVIEWER_NO_MMAP"))
+		return false;
+
+	int fd = open(fname.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) || (size_t)info.st_size < sz)
+	{
+		close(fd);
+		return false;
+	}
+
+	void *p = mmap(NULL, sz, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (p == MAP_FAILED)
+	{
+		std::cerr << "unable to map " << fname << ", reading instead\n";
+		return false;
+	}
+
+	// The first touch is the sequential min/max scan; after that the
+	// renderer wants the whole thing resident.  Huge pages only help if
+	// the filesystem supports them, so failure there is not an error.
+
+#ifdef MADV_HUGEPAGE
+	madvise(p, sz, MADV_HUGEPAGE);
+#endif
+	madvise(p, sz, MADV_SEQUENTIAL);
+	madvise(p, sz, MADV_WILLNEED);
+
+	v = p;
+	return true;
+}
+
+void
+Volume::_unmap()
+{
+	munmap(mapped, mappedSize);
+	mapped = NULL;
+	mappedSize = 0;
+}
+
+void
+Volume::_closeBricks()
+{
+	delete brickCache;
+	delete brickFile;
+	brickCache = NULL;
+	brickFile = NULL;
+}
+
+// Memory budget for paged volumes: VOLVIEWER_BRICK_BUDGET megabytes,
+// or half of physical memory
+
+static size_t
+brick_budget()
+{
+	const char *e = getenv("VOLVIEWER_BRICK_BUDGET");
+	if (e)
+		return ((size_t)atol(e)) << 20;
+
+	return (((size_t)sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE)) / 2;
+}
+
+bool
+Volume::UpdateView(Camera& camera, bool wait)
+{
+	if (shareSource)
+		return shareSource->UpdateView(camera, wait);
+
+	if (! brickCache)
+		return true;
+
+	float planes[5][4], eye[3];
+	camera.getFrustum(planes);
+	camera.getPos(eye);
+
+	brickCache->SetView(eye, planes, 5);
+
+	return wait ? brickCache->Wait() : brickCache->Idle();
+}
+
+void
+Volume::BeginRender()
+{
+	if (shareSource)
+		shareSource->BeginRender();
+	else if (brickCache)
+		brickCache->BeginRead();
+}
+
+void
+Volume::EndRender()
+{
+	if (shareSource)
+		shareSource->EndRender();
+	else if (brickCache)
+		brickCache->EndRead();
+}
+
+void
+Volume::SetGridSpacing(float sx, float sy, float sz)
+{
+	spacing[0] = sx; spacing[1] = sy; spacing[2] = sz; mod = true;
+	ospSet3f(ospv, "gridSpacing", sx, sy, sz);
+}
+
+Volume *
+Volume::GetLevel(int l)
+{
+	if (l <= 0 || pyramid.empty())
+		return this;
+	return pyramid[(l < (int)pyramid.size() ? l : pyramid.size()) - 1];
+}
+
+void
+Volume::_freePyramid()
+{
+	for (size_t i = 0; i < pyramid.size(); i++)
+		delete pyramid[i];
+	pyramid.clear();
+}
+
+// A cached level is used if it is at least as new as the imported file
+// and has the expected size and type
+
+bool
+Volume::_loadLevel(const std::string& name, int lx, int ly, int lz, VolumeData& d)
+{
+	struct stat lst, sst;
+	if (stat(name.c_str(), &lst) || stat(source.c_str(), &sst) || lst.st_mtime < sst.st_mtime)
+		return false;
+
+	if (! Load(name, d))
+		return false;
+
+	if (d.x != lx || d.y != ly || d.z != lz || d.type != type)
+	{
+		std::cerr << "ignoring stale pyramid level " << name << "\n";
+		d.Free();
+		return false;
+	}
+
+	return true;
+}
+
+bool
+Volume::BuildPyramid(int levels, bool cache)
+{
+	if (levels == (int)pyramid.size())
+		return true;
+
+	_freePyramid();
+
+	if (levels <= 0)
+		return true;
+
+	// Building levels from a paged volume would read all of it
+
+	if (! shared || brickCache || ! voxels)
+		return false;
+
+	cache = cache && source != "";
+
+	Volume *above = this;
+	for (int l = 1; l <= levels; l++)
 	{
-		unsigned char *ptr = (unsigned char *)v;
-		m = *ptr;
-		M = *ptr;
-		size_t n = ((size_t)x)*((size_t)y)*((size_t)z);
-		for (size_t i = 0; i < n; i++, ptr++)
+		int lx, ly, lz;
+		float s[3];
+		PyramidLevel(above->x, above->y, above->z, lx, ly, lz, s);
+
+		std::stringstream name;
+		name << source << ".lod" << l << ".brk";
+
+		VolumeData d;
+		if (! cache || ! _loadLevel(name.str(), lx, ly, lz, d))
 		{
-			if (m > *ptr) m = *ptr;
-			if (M < *ptr) M = *ptr;
+			d.voxels = Downsample(above->voxels, type, above->x, above->y, above->z, lx, ly, lz);
+			if (! d.voxels)
+			{
+				std::cerr << "can't build a pyramid of " << type << " voxels\n";
+				break;
+			}
+
+			if (cache && ! BrickFile::Write(name.str(), type, lx, ly, lz, lx, ly < 32 ? ly : 32, lz < 32 ? lz : 32, d.voxels))
+				std::cerr << "unable to cache pyramid level " << l << "\n";
 		}
+
+		Volume *v = new Volume;
+		v->Initialize(true);
+		v->SetType(type);
+		v->SetDimensions(lx, ly, lz);
+		v->SetGridSpacing(above->spacing[0]*s[0], above->spacing[1]*s[1], above->spacing[2]*s[2]);
+		v->SetSamplingRate(samplingRate);
+		v->ospTransferFunction = ospTransferFunction;
+		ospSetObject(v->ospv, "transferFunction", ospTransferFunction);
+		v->SetVoxels(d.voxels);
+		if (nIso)
+			v->SetIsovalues(nIso, isoValues);
+		v->commit();
+
+		pyramid.push_back(v);
+		above = v;
 	}
+
+	return levels == (int)pyramid.size();
 }
 
-void 
-Volume::Import(const std::string &filename, TransferFunction& tf)
+void
+VolumeData::Free()
 {
-	size_t x, y, z;
-	std::string type;
-	char rfile[256];
-	void *data;
+	if (mapped)
+		munmap(voxels, size);
+	else
+		free(voxels);
+	voxels = NULL;
+	size = 0;
+	mapped = false;
+}
 
+bool
+Volume::Load(const std::string &filename, VolumeData& d)
+{
 	std::string dir((filename.find_last_of("/") == std::string::npos) ? "" : filename.substr(0, filename.find_last_of("/")+1));
 
 	if (filename.substr(filename.find_last_of(".")+1) == "vol")
 	{
+		char rfile[256];
+
 		std::ifstream in;
 		in.open(filename.c_str());
-		in >> x >> y >> z >> type >> rfile;
-		std::cerr << x << " " << y << " " << z << " " << type << " " << rfile << "\n";
+		in >> d.x >> d.y >> d.z >> d.type >> rfile;
+		std::cerr << d.x << " " << d.y << " " << d.z << " " << d.type << " " << rfile << "\n";
 		in.close();
 
-		size_t k = x * y * z;
-		size_t sz;
-		if (type == "float")
-			sz = k * sizeof(float);
-		else if (type == "uchar")
-			sz = k;
-		else
+		size_t k = ((size_t)d.x) * d.y * d.z;
+		d.size = k * VoxelSize(d.type);
+		if (! d.size)
 		{
-			std::cerr << "unrecognized type: " << type << "\n";
-			std::exit(1);
+			std::cerr << "unrecognized type: " << d.type << "\n";
+			return false;
 		}
 
-		data = (void *)new char[sz];
+		std::string rname(rfile[0] == '/' ? std::string(rfile) : dir + rfile);
 
-		in.open(rfile[0] == '/' ? rfile : (dir + rfile).c_str(), std::ios::binary | std::ios::in);
-		in.read((char *)data, sz);
-		in.close();
+		if (_mapRaw(rname, d.size, d.voxels))
+			d.mapped = true;
+		else
+		{
+			d.voxels = malloc(d.size);
+
+			in.open(rname.c_str(), std::ios::binary | std::ios::in);
+			in.read((char *)d.voxels, d.size);
+			in.close();
+		}
 
-		Initialize(false);
+		if (d.type == "half")
+			_widenHalf(d);
 	}
 	else if (filename.substr(filename.find_last_of(".")+1) == "vti")
 	{
-		vtkXMLImageDataReader *rdr = vtkXMLImageDataReader::New();
+		// Read the scalars straight into a buffer the shared volume can
+		// own; doubles are narrowed to float as they stream in
+
+		VTIReader *rdr = VTIReader::New();
 		rdr->SetFileName(filename.c_str());
+		rdr->GetInfo();
+
+		const char *name = rdr->GetScalarsName();
+		if (! name)
+		{
+			std::cerr << "No scalar point data in " << filename << "\n";
+			rdr->Delete();
+			return false;
+		}
+
+		const char *t;
 		std::cerr << "loading VTI\n";
-		rdr->Update();
+		d.voxels = (void *)rdr->GetData(name, t);
 		std::cerr << "loading VTI done\n";
 
-		imagedata = rdr->GetOutput();
-		imagedata->Register(imagedata);
+		if (! d.voxels)
+		{
+			std::cerr << "Can only handle unsigned char, short, unsigned short, float and double VTIs\n";
+			rdr->Delete();
+			return false;
+		}
+
+		size_t *xyz = rdr->GetCounts();
+		d.x = xyz[0];
+		d.y = xyz[1];
+		d.z = xyz[2];
+		d.type = t;
+		d.size = ((size_t)d.x) * d.y * d.z * VoxelSize(d.type);
+
 		rdr->Delete();
+	}
+	else if (filename.substr(filename.find_last_of(".")+1) == "brk")
+	{
+		// Decode every brick, in parallel; the header has the range
 
-		int *xyz = imagedata->GetDimensions();
-		
-		x = xyz[0];
-		y = xyz[1];
-		z = xyz[2];
+		BrickFile f;
+		if (! f.Open(filename))
+			return false;
 
-		if (imagedata->GetScalarType() == VTK_UNSIGNED_CHAR)
-		{
-			std::cerr << "Loading UCHAR\n";
-			type = "uchar";
-			data = imagedata->GetScalarPointer();
-			Initialize(true);
-			std::cerr << "Loading UCHAR done\n";
-		}
-		else if (imagedata->GetScalarType() == VTK_FLOAT)
-		{
-			std::cerr << "Loading FLOAT\n";
-			type = "float";
-			data = imagedata->GetScalarPointer();
-			Initialize(true);
-			std::cerr << "Loading FLOAT done\n";
-		}
-		else if (imagedata->GetScalarType() == VTK_DOUBLE)
-		{
-			std::cerr << "Loading DOUBLE\n";
-			type = "float";
-			data = (void *) new float[x*y*z*sizeof(float)];
-			float *dst = (float *)data;
-			double *src = (double *)imagedata->GetScalarPointer();
-			for (int i = 0; i < x*y*z; i++)
-				*dst++ = (float) *src++;
-			imagedata->Delete();
-			imagedata = NULL;
-			Initialize(false);
-			std::cerr << "Loading DOUBLE done\n";
-		}
-		else
+		f.GetDimensions(d.x, d.y, d.z);
+		f.GetType(d.type);
+		d.size = ((size_t)d.x) * d.y * d.z * f.GetVoxelSize();
+		d.voxels = malloc(d.size);
+
+		if (! d.voxels || ! f.ReadAll(d.voxels))
 		{
-			std::cerr << "Can only handle unsigned char, float and double VTIs\n";
-			exit(1);
+			std::cerr << "unable to load " << filename << "\n";
+			d.Free();
+			return false;
 		}
+
+		f.GetMinMax(d.m, d.M);
+		return true;
 	}
 	else
 	{
-		std::cerr << "Can only handle .vol and .vti files\n";
-		exit(1);
+		std::cerr << "Can only handle .vol, .vti and .brk files\n";
+		return false;
 	}
 
+	ComputeMinMax(d.voxels, ((size_t)d.x) * d.y * d.z, d.type, d.m, d.M);
+	return true;
+}
 
-	SetDimensions(x, y, z);
+void 
+Volume::Import(const std::string &filename, TransferFunction& tf)
+{
+	TraceScope trace(TRACE_VOLUME_LOAD);
+
+	if (filename.substr(filename.find_last_of(".")+1) != "brk")
+	{
+		VolumeData d;
+		if (! Load(filename, d))
+			exit(1);
+
+		Import(d, tf);
+		source = filename;
+		return;
+	}
+
+	Initialize(true);
+
+	brickFile = new BrickFile;
+	if (! brickFile->Open(filename))
+		exit(1);
+
+	int bx, by, bz;
+	std::string type;
+	brickFile->GetDimensions(bx, by, bz);
+	brickFile->GetType(type);
+
+	brickCache = new BrickCache(brickFile, brick_budget());
+
+	SetDimensions(bx, by, bz);
 	SetType(type);
 	SetSamplingRate(1.0);
 	SetTransferFunction(tf);
-	SetVoxels(data);
+	SetVoxels(brickCache->GetVoxels());
 	commit();
 
+	source = filename;
+
 	float m, M;
 	GetMinMax(m, M);
 	tf.SetMin(m);
 	tf.SetMax(M);
 }
 
+// Take ownership of loaded voxels.  The data is always attached as a
+// shared volume; the volume frees (or unmaps) it when done.
+
+void
+Volume::Import(VolumeData& d, TransferFunction& tf)
+{
+	Initialize(true);
+	source = "";
+
+	if (d.mapped)
+	{
+		mapped = d.voxels;
+		mappedSize = d.size;
+	}
+
+	// Load already has the range
+	m = d.m;
+	M = d.M;
+	haveMinMax = true;
+
+	SetDimensions(d.x, d.y, d.z);
+	SetType(d.type);
+	SetSamplingRate(1.0);
+	SetTransferFunction(tf);
+	SetVoxels(d.voxels);
+	commit();
+
+	if (mapped)
+		madvise(mapped, mappedSize, MADV_RANDOM);
+
+	d.voxels = NULL;
+	d.size = 0;
+	d.mapped = false;
+
+	tf.SetMin(m);
+	tf.SetMax(M);
+}
+
+void
+Volume::Share(Volume& src, TransferFunction& tf)
+{
+	if (! src.CanShare())
+	{
+		std::cerr << "can only share a loaded shared volume\n";
+		exit(1);
+	}
+
+	Initialize(true);
+	shareSource = &src;
+
+	m = src.m;
+	M = src.M;
+	haveMinMax = true;
+
+	SetDimensions(src.x, src.y, src.z);
+	SetType(src.type);
+	SetSamplingRate(src.samplingRate);
+	SetGridSpacing(src.spacing[0], src.spacing[1], src.spacing[2]);
+	SetTransferFunction(tf);
+	SetVoxels(src.voxels);
+	commit();
+
+	// Levels share src's levels; sharing sets the transfer function
+	// range, so that is put back below
+
+	for (size_t i = 0; i < src.pyramid.size(); i++)
+	{
+		Volume *l = new Volume;
+		l->Share(*src.pyramid[i], tf);
+		pyramid.push_back(l);
+	}
+
+	tf.SetMin(m);
+	tf.SetMax(M);
+}
+
+// Drop the voxels and OSPRay objects but remember what the volume was
+// (size, type and range), so a series can reload it later
+
+void
+Volume::Release()
+{
+	if (ospv) ospRelease(ospv);
+	if (data) ospRelease(data);
+	ospv = NULL;
+	data = NULL;
+	nIso = 0;
+
+	_freeVoxels();
+	_freePyramid();
+
+	mod = true;
+}
+
+bool
+Volume::IsLoaded()
+{
+	return ospv != NULL;
+}
+
 void
 Volume::Attach(const std::string& type, int xsz, int ysz, int zsz, void *data, TransferFunction& tf)
 {
@@ -342,19 +857,26 @@ Volume::Attach(const std::string& type, int xsz, int ysz, int zsz, void *data, T
 	commit();
 }
 
+VolumeSeries::~VolumeSeries()
+{
+	delete loader;
+}
+
 void
-VolumeSeries::Import(const std::string &filename, TransferFunction& tf)
+VolumeSeries::Import(const std::string &filename, TransferFunction& _tf)
 {
-	if (filename.substr(filename.rfind('.')) == ".vol" || filename.substr(filename.rfind('.')) == ".vti")
+	delete loader;
+	loader = NULL;
+	tf = &_tf;
+
+	std::string ext(filename.substr(filename.rfind('.')));
+	if (ext == ".vol" || ext == ".vti" || ext == ".brk")
 	{
 		series.resize(1);
-		series[0].Import(filename, tf);
+		series[0].Import(filename, _tf);
 	}
 	else
 	{
-		int series_x, series_y, series_z;
-		std::string series_type;
-
 		std::string dir((filename.find_last_of("/") == std::string::npos) ? "" : filename.substr(0, filename.find_last_of("/")+1));
 
 		std::ifstream in;
@@ -363,46 +885,143 @@ VolumeSeries::Import(const std::string &filename, TransferFunction& tf)
 		int n;
 		in >> n;
 
-		series.resize(n);
-
+		std::vector<std::string> names;
 		for (int i = 0; i < n; i++)
 		{
 			char vfile[256];
 			in >> vfile;
 
 			if (vfile[0] == '/' || vfile[0] == '.')
-				series[i].Import(vfile, tf);
+				names.push_back(vfile);
 			else
-				series[i].Import(dir + '/' + vfile, tf);
+				names.push_back(dir + vfile);
+		}
+
+		series.clear();
+		series.resize(n);
+
+		if (window > 0)
+		{
+			// Members are read by the loader threads as the cursor comes
+			// near them; only the first is needed now
 
-			if (i == 0)
+			const char *e = getenv("VOLVIEWER_IO_THREADS");
+			loader = new SeriesLoader(names, e ? atoi(e) : 2);
+
+			cursor = 0;
+			direction = 1;
+			GetMember(0);
+		}
+		else
+			for (int i = 0; i < n; i++)
 			{
-				series[i].GetDimensions(series_x, series_y, series_z);
-				series[i].GetType(series_type);
+				series[i].Import(names[i], _tf);
+				_checkMember(i);
 			}
-			else
-			{
-				int x, y, z;
-				std::string type;
+	}
+}
+
+void
+VolumeSeries::_checkMember(int i)
+{
+	int x, y, z, series_x, series_y, series_z;
+	std::string type, series_type;
 
-				series[i].GetDimensions(x, y, z);
-				series[i].GetType(type);
+	series[0].GetDimensions(series_x, series_y, series_z);
+	series[0].GetType(series_type);
+	series[i].GetDimensions(x, y, z);
+	series[i].GetType(type);
 
-				if (x != series_x || y != series_y || z != series_z || type != series_type)
-				{
-					std::cerr << "Series member mismatch\n";
-					exit(1);
-				}
-			}
-		}
+	if (x != series_x || y != series_y || z != series_z || type != series_type)
+	{
+		std::cerr << "Series member mismatch\n";
+		exit(1);
+	}
+}
+
+// Hand loaded data to member i.  The transfer function range stays
+// where it is, except for the first member of the series.
+
+void
+VolumeSeries::_attach(int i, VolumeData& d)
+{
+	float m = tf->GetMin(), M = tf->GetMax();
+
+	series[i].Import(d, *tf);
+	if (isovalues.size())
+		series[i].SetIsovalues(isovalues.size(), &isovalues[0]);
+
+	if (series[0].IsLoaded())
+		_checkMember(i);
+
+	if (i != 0)
+	{
+		tf->SetMin(m);
+		tf->SetMax(M);
 	}
 }
 
+Volume *
+VolumeSeries::GetMember(int i)
+{
+	if (! loader)
+		return &series[i];
+
+	if (i != cursor)
+		direction = i > cursor ? 1 : -1;
+	cursor = i;
+
+	// The window runs mostly ahead of the cursor in the direction it
+	// last moved, with a quarter of it kept behind for small steps back
+
+	int behind = window / 4;
+	int ahead = window - 1 - behind;
+	int n = series.size();
+
+	std::vector<int> order(1, i);
+	for (int k = 1; k <= ahead; k++)
+		if (i + k*direction >= 0 && i + k*direction < n)
+			order.push_back(i + k*direction);
+	for (int k = 1; k <= behind; k++)
+		if (i - k*direction >= 0 && i - k*direction < n)
+			order.push_back(i - k*direction);
+
+	std::vector<char> inWindow(n, 0);
+	for (size_t k = 0; k < order.size(); k++)
+		inWindow[order[k]] = 1;
+
+	for (int k = 0; k < n; k++)
+		if (! inWindow[k] && series[k].IsLoaded())
+			series[k].Release();
+
+	std::vector<int> missing;
+	for (size_t k = 0; k < order.size(); k++)
+		if (! series[order[k]].IsLoaded())
+			missing.push_back(order[k]);
+
+	loader->Want(missing);
+
+	VolumeData d;
+	if (! series[i].IsLoaded())
+	{
+		if (! loader->Take(i, d))
+			exit(1);
+		_attach(i, d);
+	}
+
+	int j;
+	while (loader->TakeReady(j, d))
+		_attach(j, d);
+
+	return &series[i];
+}
+
 void
 VolumeSeries::ResetMinMax()
 {
 	for (std::vector<Volume>::iterator v = series.begin(); v != series.end(); ++v)
-		v->ResetMinMax();
+		if (v->IsLoaded())
+			v->ResetMinMax();
 }
 
 void
@@ -459,6 +1078,9 @@ VolumeSeries::SetIsovalues(int n, float *v)
 		exit(1);
 	}
 
+	// Kept for members that are loaded later
+	isovalues.assign(v, v + n);
+
 	for (std::vector<Volume>::iterator s = series.begin(); s != series.end(); ++s)
 		s->SetIsovalues(n, v);
 }
@@ -4,7 +4,32 @@
 #include <vtkImageData.h>
 #include <vector>
 
+#include "MinMax.h"
+
 class TransferFunction;
+class Camera;
+class BrickFile;
+class BrickCache;
+class SeriesLoader;
+
+// Voxels of a volume file as read from disk, before any OSPRay objects
+// exist for them.  Filled in by Volume::Load, which doesn't touch OSPRay
+// and so can run off the main thread.
+
+class VolumeData
+{
+public:
+		VolumeData() : x(0), y(0), z(0), voxels(NULL), size(0), mapped(false), m(0), M(0) {}
+
+		void Free();
+
+		int 				x, y, z;
+		std::string type;
+		void 				*voxels;
+		size_t 			size;
+		bool 				mapped;
+		float 			m, M;
+};
 
 class Volume
 {
@@ -28,26 +53,99 @@ public:
 		void SetVoxels(void*  _v);
 		void GetVoxels(void*& _v);
 		void GetMinMax(float& _m, float& _M);
-		void SetIsovalues(int n, float *v);
+
+		// When enabled, each min/max scan also fills in a value histogram
+		void EnableHistogram(bool b) { histogramEnabled = b; }
+		const VoxelHistogram& GetHistogram() { return histogram; }
+
+		// Returns false if the volume already has these isovalues
+		bool SetIsovalues(int n, float *v);
+
+		// Load decodes .brk files in full (as series members are loaded);
+		// Import pages a single .brk file in on demand
+
+		static bool Load(const std::string& s, VolumeData& d);
 
 		void Import(const std::string& s, TransferFunction& t);
+		void Import(VolumeData& d, TransferFunction& t);
 		void Import(const char *s, TransferFunction& t) { Import(std::string(s), t); }
 		void Attach(const std::string&, int, int, int, void *, TransferFunction&);
 
+		// Render src's voxels through a volume of our own, with its own
+		// isovalues and transfer function.  src must outlive this volume.
+		void Share(Volume& src, TransferFunction& tf);
+		// Paged volumes can't be shared: their cache follows one view
+		bool CanShare() { return shared && voxels != NULL && brickCache == NULL; }
+
+		void Release();
+		bool IsLoaded();
+
+		// For volumes paged from a brick file (.brk): point the prefetcher
+		// at the camera's view.  If wait is set, block until the visible
+		// bricks are in.  Returns true when nothing is left to load; always
+		// true for in-core volumes.
+
+		bool UpdateView(Camera& camera, bool wait = false);
+
+		// Bracket each frame rendered from a paged volume, so the prefetcher
+		// doesn't change voxels under it; nothing for in-core volumes
+
+		void BeginRender();
+		void EndRender();
+
+		// Coarser copies of an in-core volume, for rendering while the view
+		// is changing and for previews.  Level l (1 .. levels) has about
+		// 1/2^l of the voxels along each axis, and a grid spacing that puts
+		// it in the same place as the full volume.  Levels follow this
+		// volume's isovalues, sampling rate and transfer function.  With
+		// cache set, levels are read from (or else written to) brick files
+		// next to the imported file, named file.lod<l>.brk.
+
+		bool BuildPyramid(int levels, bool cache = false);
+		int  GetNumberOfLevels() { return 1 + pyramid.size(); }
+		Volume *GetLevel(int l);
+
+		void SetGridSpacing(float sx, float sy, float sz);
+
 private:
 		vtkImageData *imagedata;
 
 		void _setMinMax(void *v);
 
+		static bool _mapRaw(const std::string& fname, size_t sz, void*& v);
+		static void _widenHalf(VolumeData& d);
+		OSPDataType _ospType();
+		void _unmap();
+		void _closeBricks();
+		void _freeVoxels();
+		void _setMacrocells();
+		void _freePyramid();
+		bool _loadLevel(const std::string& name, int lx, int ly, int lz, VolumeData& d);
+
 		bool 								shared;
 
 		int 							  x, y, z;
+		float								spacing[3];
 		std::string 			  type;
 		float							  samplingRate;
 		OSPTransferFunction ospTransferFunction;
 		void								*voxels;
 
+		void								*mapped;
+		size_t							mappedSize;
+
+		Volume							*shareSource;
+		BrickFile						*brickFile;
+		BrickCache					*brickCache;
+
 		float 							m, M;
+		bool								histogramEnabled;
+		bool								haveMinMax;
+		VoxelHistogram			histogram;
+		std::vector<float>	macrocells;
+
+		std::string					source;
+		std::vector<Volume *> pyramid;
 
 		int									nIso;
 		float 							*isoValues;
@@ -60,8 +158,15 @@ private:
 class VolumeSeries
 {
 public:
-		VolumeSeries() {}
-		~VolumeSeries() {}
+		VolumeSeries() : window(0), loader(NULL), tf(NULL), cursor(0), direction(1) {}
+		~VolumeSeries();
+
+		// With a window of n > 0, members of a .ser series are read in the
+		// background as GetMember moves through the series, and at most n
+		// of them are kept.  0 (the default) reads them all at Import.
+		// Set before Import.
+
+		void SetWindow(int n) { window = n; }
 
 		void Import(const std::string &filename, TransferFunction& tf);
 		void ResetMinMax();
@@ -73,9 +178,17 @@ public:
 		void SetTransferFunction(TransferFunction _tf);
 
 		int GetNumberOfMembers() { return series.size(); }
-		Volume *GetMember(int i) { return &series[i]; }
+		Volume *GetMember(int i);
 
 private:
+		void _attach(int i, VolumeData& d);
+		void _checkMember(int i);
+
 		std::vector<Volume> series;
-};
 
+		int									window;
+		SeriesLoader				*loader;
+		TransferFunction		*tf;
+		int									cursor, direction;
+		std::vector<float>	isovalues;
+};
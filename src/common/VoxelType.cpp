@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "VoxelType.h"
+#include "Parallel.h"
+#include "Half.h"
+
+// Below this many voxels the threads cost more than they save
+
+#define CONVERT_SERIAL_LIMIT	(1 << 18)
+
+int
+VoxelSize(const std::string& type)
+{
+	if (type == "uchar") return 1;
+	if (type == "short" || type == "ushort" || type == "half") return 2;
+	if (type == "float") return 4;
+	return 0;
+}
+
+bool
+VoxelTypeNative(const std::string& type)
+{
+	return VoxelSize(type) && type != "half";
+}
+
+// Widen by moving the exponent and mantissa into place and rebiasing
+// the exponent; infinities and NaNs need the exponent rebiased again,
+// denormals are renormalized by a float subtraction.  The special cases
+// are selected with masks rather than branches.
+
+static void
+half_to_float(const uint16_t *src, float *dst, size_t n)
+{
+	uint32_t *out = (uint32_t *)dst;
+	for (size_t i = 0; i < n; i++)
+	{
+		uint32_t h = src[i];
+		uint32_t o = (h & 0x7fff) << 13;
+		uint32_t e = o & 0x0f800000;
+		uint32_t special = 0u - (uint32_t)(e == 0x0f800000);
+		uint32_t denormal = 0u - (uint32_t)(e == 0);
+
+		o += 0x38000000 + (special & 0x38000000) + (denormal & 0x00800000);
+
+		float f, bias = 6.103515625e-05f;					// 2^-14
+		uint32_t r;
+		memcpy(&f, &o, 4);
+		f -= bias;
+		memcpy(&r, &f, 4);
+		o = (o & ~denormal) | (r & denormal);
+
+		out[i] = o | ((h & 0x8000) << 16);
+	}
+}
+
+static void
+float_to_half(const float *src, uint16_t *dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		dst[i] = FloatToHalf(src[i]);
+}
+
+template<typename S, typename D>
+class ConvertTask : public ParallelTask
+{
+public:
+	ConvertTask(const S *_src, D *_dst, size_t _n, void (*_f)(const S *, D *, size_t))
+		: src(_src), dst(_dst), n(_n), f(_f) {}
+
+	void run(int i, int count)
+	{
+		size_t s = (n * i) / count;
+		size_t e = (n * (i + 1)) / count;
+		f(src + s, dst + s, e - s);
+	}
+
+private:
+	const S *src;
+	D *dst;
+	size_t n;
+	void (*f)(const S *, D *, size_t);
+};
+
+template<typename S, typename D>
+static void
+convert(const S *src, D *dst, size_t n, void (*f)(const S *, D *, size_t))
+{
+	if (n < CONVERT_SERIAL_LIMIT)
+	{
+		f(src, dst, n);
+		return;
+	}
+
+	ConvertTask<S, D> task(src, dst, n, f);
+	ParallelRun(task, 4*ParallelThreadCount());
+}
+
+void
+HalfToFloat(const uint16_t *src, float *dst, size_t n)
+{
+	convert(src, dst, n, half_to_float);
+}
+
+void
+FloatToHalf(const float *src, uint16_t *dst, size_t n)
+{
+	convert(src, dst, n, float_to_half);
+}
+
+float *
+WidenHalf(void *half, size_t n, bool mapped)
+{
+	float *f = (float *)malloc(n * sizeof(float));
+	if (f)
+		HalfToFloat((const uint16_t *)half, f, n);
+	if (! mapped)
+		free(half);
+	return f;
+}
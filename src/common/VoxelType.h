@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Voxel types, by their OSPRay voxelType strings: "uchar", "short",
+// "ushort" and "float" are handed to OSPRay as they are.  "half" (IEEE
+// binary16) is a storage type only - OSPRay can't sample it, so half
+// data is widened to float as it is loaded.
+
+// Bytes per voxel, or 0 if the type is not recognized
+
+int VoxelSize(const std::string& type);
+
+// True if OSPRay can render the type directly
+
+bool VoxelTypeNative(const std::string& type);
+
+// Multithreaded bulk conversions.  The inner loops are branch-free so the
+// compiler can vectorize them; HalfToFloat agrees with the scalar version
+// in Half.h for every input.
+
+void HalfToFloat(const uint16_t *src, float *dst, size_t n);
+void FloatToHalf(const float *src, uint16_t *dst, size_t n);
+
+// Replace a malloc'ed buffer of n half voxels with a malloc'ed buffer of
+// n floats.  The half buffer is freed unless it is mapped, in which case
+// the caller still owns it.
+
+float *WidenHalf(void *half, size_t n, bool mapped);
@@ -2,6 +2,9 @@
 #include <iostream>
 #include <stdio.h>
 #include <png.h>
+#include <vector>
+
+#include "mypng.h"
 
 using namespace std;
 
@@ -22,6 +25,35 @@ void png_warning(png_structp png_ptr, png_const_charp warning_msg)
 }
 
 int write_png(const char *filename, int w, int h, unsigned int *rgba)
+{
+  return write_png(filename, w, h, rgba, -1, 0);
+}
+
+// Everything but where the bytes go
+
+static void write_rows(png_structp png_ptr, png_infop info_ptr, int w, int h, unsigned int *rgba, int level, int filters)
+{
+  if (level >= 0)
+    png_set_compression_level(png_ptr, level);
+
+  if (filters)
+    png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, filters);
+
+  png_set_IHDR(png_ptr, info_ptr, w, h, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+  	PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+  png_byte **rows = new png_byte *[h];
+
+  for (int i = 0; i < h; i++)
+    rows[i] = (png_bytep)(rgba + i*w);
+
+  png_set_rows(png_ptr, info_ptr, rows);
+  png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+
+  delete[] rows;
+}
+
+int write_png(const char *filename, int w, int h, unsigned int *rgba, int level, int filters)
 {
   png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, png_warning, png_error);
   if (!png_ptr)
@@ -54,22 +86,44 @@ int write_png(const char *filename, int w, int h, unsigned int *rgba)
   // }
 
   png_init_io(png_ptr, fp);
+  write_rows(png_ptr, info_ptr, w, h, rgba, level, filters);
+  png_destroy_write_struct(&png_ptr, &info_ptr);
 
-  png_set_IHDR(png_ptr, info_ptr, w, h, 8, PNG_COLOR_TYPE_RGB_ALPHA,
-  	PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  fclose(fp);
 
-  png_byte **rows = new png_byte *[h];
+  return 1;
+}
 
-  for (int i = 0; i < h; i++)
-    rows[i] = (png_bytep)(rgba + i*w);
+static void append_bytes(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+  std::vector<unsigned char> *out = (std::vector<unsigned char> *)png_get_io_ptr(png_ptr);
+  out->insert(out->end(), data, data + length);
+}
 
-  png_set_rows(png_ptr, info_ptr, rows);
-  png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+static void flush_bytes(png_structp png_ptr) {}
 
-  png_destroy_write_struct(&png_ptr, &info_ptr);
-  free(rows);
+int write_png(std::vector<unsigned char>& out, int w, int h, unsigned int *rgba, int level, int filters)
+{
+  out.clear();
 
-  fclose(fp);
+  png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, png_warning, png_error);
+  if (!png_ptr)
+  {
+    cerr << "Unable to create PNG write structure\n";
+    return 0;
+  }
+
+  png_infop info_ptr = png_create_info_struct(png_ptr);
+  if (!info_ptr)
+  {
+    png_destroy_write_struct(&png_ptr, (png_infopp)NULL);
+    cerr << "Unable to create PNG info structure\n";
+    return 0;
+  }
+
+  png_set_write_fn(png_ptr, (png_voidp)&out, append_bytes, flush_bytes);
+  write_rows(png_ptr, info_ptr, w, h, rgba, level, filters);
+  png_destroy_write_struct(&png_ptr, &info_ptr);
 
   return 1;
 }
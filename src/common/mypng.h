@@ -1,2 +1,12 @@
 #pragma once
+
+#include <vector>
+
 int write_png(const char *filename, int w, int h, unsigned int *rgba);
+
+// level is the zlib level 0-9 (-1: libpng's default); filters is a mask
+// of PNG_FILTER_NONE/SUB/UP/AVG/PAETH (0: libpng's default)
+int write_png(const char *filename, int w, int h, unsigned int *rgba, int level, int filters);
+
+// The same, into memory
+int write_png(std::vector<unsigned char>& out, int w, int h, unsigned int *rgba, int level, int filters);
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include "BrickFile.h"
+#include "VoxelType.h"
+
+// Convert a .vol volume into a pre-bricked .brk file for out-of-core
+// rendering.  By default bricks span the whole x extent of the volume
+// and are sized to about 4MB.  Half volumes are widened to float, since
+// bricks are paged into OSPRay as they are.
+//
+// Bricks can be compressed (see BrickFile.h).  Smaller bricks give finer
+// per-brick ranges for empty-space skipping of paged volumes, at some
+// cost in compression.
+
+using namespace std;
+
+void
+syntax(char *a)
+{
+	cerr << "syntax: " << a << " [options] in.vol out.brk\n";
+	cerr << "options:\n";
+	cerr << "  -b bx by bz   brick size (xres by bz, about 4MB)\n";
+	cerr << "  -c codec      raw, zlib, q16 or q8 (raw)\n";
+	cerr << "  -l level      zlib compression level (1)\n";
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int bx = -1, by = -1, bz = -1;
+	int codec = BRICK_RAW, level = 1;
+	string in, out;
+
+	for (int i = 1; i < argc; i++)
+		if (argv[i][0] == '-')
+			switch(argv[i][1])
+			{
+				case 'b': bx = atoi(argv[++i]);
+									by = atoi(argv[++i]);
+									bz = atoi(argv[++i]); break;
+				case 'c': codec = BrickFile::CodecFromName(argv[++i]);
+									if (codec < 0) syntax(argv[0]);
+									break;
+				case 'l': level = atoi(argv[++i]); break;
+				default:  syntax(argv[0]);
+			}
+		else if (in == "")
+			in = argv[i];
+		else if (out == "")
+			out = argv[i];
+		else
+			syntax(argv[0]);
+
+	if (out == "")
+		syntax(argv[0]);
+
+	int x, y, z;
+	string type, rfile;
+
+	ifstream hdr(in.c_str());
+	hdr >> x >> y >> z >> type >> rfile;
+	if (hdr.fail())
+	{
+		cerr << "can't read " << in << "\n";
+		exit(1);
+	}
+	hdr.close();
+
+	int vsz = VoxelSize(type);
+	if (! vsz)
+	{
+		cerr << "unrecognized type: " << type << "\n";
+		exit(1);
+	}
+
+	if (rfile[0] != '/' && in.find_last_of("/") != string::npos)
+		rfile = in.substr(0, in.find_last_of("/")+1) + rfile;
+
+	if (bx == -1)
+	{
+		bx = x;
+		int bsz = type == "half" ? (int)sizeof(float) : vsz;
+		by = bz = (int)sqrt((4.0 * 1024 * 1024) / ((double)x * bsz));
+		if (by < 1) by = bz = 1;
+		if (by > y) by = y;
+		if (bz > z) bz = z;
+	}
+
+	size_t sz = ((size_t)x)*y*z*vsz;
+
+	int fd = open(rfile.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) || (size_t)st.st_size < sz)
+	{
+		cerr << "can't read " << sz << " bytes from " << rfile << "\n";
+		exit(1);
+	}
+
+	void *voxels = mmap(NULL, sz, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (voxels == MAP_FAILED)
+	{
+		cerr << "can't map " << rfile << "\n";
+		exit(1);
+	}
+
+	void *mapped = voxels;
+	if (type == "half")
+	{
+		voxels = WidenHalf(mapped, ((size_t)x)*y*z, true);
+		type = "float";
+	}
+
+	cerr << x << "x" << y << "x" << z << " " << type << " in " << bx << "x" << by << "x" << bz << " " << BrickFile::CodecName(codec) << " bricks\n";
+
+	if (! BrickFile::Write(out, type, x, y, z, bx, by, bz, voxels, codec, level))
+		exit(1);
+
+	struct stat ost;
+	if (! stat(out.c_str(), &ost))
+		cerr << ost.st_size << " bytes, " << (double)((size_t)x*y*z*VoxelSize(type)) / ost.st_size << ":1\n";
+
+	if (voxels != mapped)
+		free(voxels);
+	munmap(mapped, sz);
+	return 0;
+}
@@ -20,6 +20,7 @@
 #include "ospray/common/Ray.h"
 #include "VisRenderer.h"
 #include "ospray/volume/Volume.h"
+#include "ospray/transferFunction/TransferFunction.h"
 // ispc exports
 #include "VisRenderer_ispc.h"
 
@@ -77,14 +78,123 @@ namespace ospray {
 		float rad = getParam1f("AO radius", 0.0);
 		ispc::VisRenderer_set_AO_radius(ispcEquivalent, rad);
 
+		//! Screen bounds of the volume for tile culling; the whole screen unless given.
+		vec2f cullLower = getParam2f("cull lower", vec2f(0.f, 0.f));
+		vec2f cullUpper = getParam2f("cull upper", vec2f(1.f, 1.f));
+		ispc::VisRenderer_setCullBounds(ispcEquivalent, cullLower.x, cullLower.y, cullUpper.x, cullUpper.y);
+
+		//! Any commit restarts progressive refinement.
+		ispc::VisRenderer_setProgressive(ispcEquivalent, getParam1i("progressive", 0), getParam1f("progressive threshold", 0.002f));
+
 		float amb = getParam1f("ambient", 0.5);
 		ispc::VisRenderer_set_ambient(ispcEquivalent, amb);
 
+    //! Empty-space and isosurface cell skipping; the transfer function, isovalues or data may have changed.
+    updateMacrocells();
+
+    //! Preintegrated transfer function, if the transfer function has one.
+    updatePreintegration();
+
     //! Initialize state in the parent class, must be called after the ISPC object is created.
     Renderer::commit();
 
   }
 
+  void VisRenderer::updateMacrocells() {
+
+    //! The volume provides per-cell value ranges (see common/Macrocells.h); off if it doesn't.
+    Volume *volume = model->volume.size() ? model->volume[0].ptr : NULL;
+    Data *ranges = volume ? volume->getParamData("macrocells", NULL) : NULL;
+    int size = volume ? volume->getParam1i("macrocellSize", 0) : 0;
+
+    vec3i dims = volume ? volume->getParam3i("dimensions", vec3i(0)) : vec3i(0);
+    int nx = std::max(1, (dims.x + size - 2) / std::max(size, 1));
+    int ny = std::max(1, (dims.y + size - 2) / std::max(size, 1));
+    int nz = std::max(1, (dims.z + size - 2) / std::max(size, 1));
+
+    macrocellEmpty.clear();
+    isoActive.clear();
+    isoCoarse.clear();
+
+    if (!getParam1i("empty space skipping", 1) || !ranges || size <= 0 || ranges->numItems != (size_t) nx * ny * nz) {
+      ispc::VisRenderer_setMacrocells(ispcEquivalent, NULL, 0, 0, 0, 0);
+      ispc::VisRenderer_setIsoCells(ispcEquivalent, NULL, NULL, 0, 0, 0);
+      return;
+    }
+
+    const float *r = (const float *) ranges->data;
+
+    //! Transparent cells.
+    TransferFunction *tf = (TransferFunction *) volume->getParamObject("transferFunction", NULL);
+    Data *opacities = tf ? tf->getParamData("opacities", NULL) : NULL;
+    vec2f range = tf ? tf->getParam2f("valueRange", vec2f(0.f, 1.f)) : vec2f(0.f, 1.f);
+
+    if (opacities && opacities->numItems >= 2 && range.y > range.x) {
+
+      //! nonzero[i] counts the non-zero opacities below table entry i.
+      const float *alpha = (const float *) opacities->data;
+      int n = opacities->numItems;
+      std::vector<int> nonzero(n + 1, 0);
+      for (int i = 0; i < n; i++) nonzero[i + 1] = nonzero[i] + (alpha[i] > 0.f ? 1 : 0);
+
+      //! The transfer function interpolates between table entries and clamps outside its range,
+      //! so a cell is transparent if every entry from below its min to above its max is zero.
+      const float scale = (n - 1) / (range.y - range.x);
+      macrocellEmpty.resize(ranges->numItems);
+
+      for (size_t c = 0; c < ranges->numItems; c++) {
+        int lo = std::min(std::max((int) floorf((r[2*c] - range.x) * scale), 0), n - 1);
+        int hi = std::min(std::max((int) ceilf((r[2*c+1] - range.x) * scale), 0), n - 1);
+        macrocellEmpty[c] = nonzero[hi + 1] == nonzero[lo];
+      }
+    }
+
+    ispc::VisRenderer_setMacrocells(ispcEquivalent, macrocellEmpty.empty() ? NULL : &macrocellEmpty[0], nx, ny, nz, size);
+
+    //! Cells an isosurface can pass through, and the same over 2x2x2 blocks of cells.
+    Data *isovalues = volume->getParamData("isovalues", NULL);
+    int cx = (nx + 1) / 2, cy = (ny + 1) / 2, cz = (nz + 1) / 2;
+
+    if (isovalues && isovalues->numItems) {
+
+      const float *iso = (const float *) isovalues->data;
+      isoActive.resize(ranges->numItems);
+      isoCoarse.assign((size_t) cx * cy * cz, 0);
+
+      for (int k = 0; k < nz; k++)
+        for (int j = 0; j < ny; j++)
+          for (int i = 0; i < nx; i++) {
+            size_t c = i + (size_t) nx * (j + (size_t) ny * k);
+            bool active = false;
+            for (size_t v = 0; v < isovalues->numItems && !active; v++)
+              active = iso[v] >= r[2*c] && iso[v] <= r[2*c+1];
+            isoActive[c] = active;
+            if (active) isoCoarse[i/2 + (size_t) cx * (j/2 + (size_t) cy * (k/2))] = 1;
+          }
+    }
+
+    ispc::VisRenderer_setIsoCells(ispcEquivalent, isoActive.empty() ? NULL : &isoActive[0],
+                                  isoCoarse.empty() ? NULL : &isoCoarse[0], cx, cy, cz);
+  }
+
+  void VisRenderer::updatePreintegration() {
+
+    Volume *volume = model->volume.size() ? model->volume[0].ptr : NULL;
+    TransferFunction *tf = volume ? (TransferFunction *) volume->getParamObject("transferFunction", NULL) : NULL;
+    Data *table = tf ? tf->getParamData("preintegrated", NULL) : NULL;
+    int n = tf ? tf->getParam1i("preintegrationSize", 0) : 0;
+    vec2f range = tf ? tf->getParam2f("valueRange", vec2f(0.f, 1.f)) : vec2f(0.f, 1.f);
+
+    //! Copied, since the transfer function replaces its table when it is next committed.
+    if (getParam1i("preintegration", 1) && table && n > 1 && table->numItems == (size_t) n * n && range.y > range.x)
+      preintegrated.assign((const float *) table->data, (const float *) table->data + 4 * table->numItems);
+    else
+      preintegrated.clear();
+
+    ispc::VisRenderer_setPreintegration(ispcEquivalent, preintegrated.empty() ? NULL : &preintegrated[0],
+                                        preintegrated.empty() ? 0 : n, range.x, range.y);
+  }
+
   void **VisRenderer::getLightsFromData(const Data *buffer) {
 
     //! Lights are optional.
@@ -21,6 +21,8 @@
 #include "ospray/lights/Light.h"
 #include "ospray/render/Renderer.h"
 
+#include <vector>
+
 namespace ospray {
 
   //! \brief A concrete implemetation of the Renderer class for rendering
@@ -57,6 +59,19 @@ namespace ospray {
     //! Gather pointers to the ISPC equivalents from an array of Light objects.
     void **getLightsFromData(const Data *buffer);
 
+    //! Flag the volume's macrocells whose value range the transfer function maps to zero opacity,
+    //! and those (and blocks of 2x2x2 of them) whose range brackets an isovalue.
+    void updateMacrocells();
+
+    //! Hand the transfer function's preintegrated table (see common/Preintegration.h) to the ISPC renderer.
+    void updatePreintegration();
+
+    //! Flags handed to the ISPC renderer.
+    std::vector<unsigned char> macrocellEmpty;
+    std::vector<unsigned char> isoActive;
+    std::vector<unsigned char> isoCoarse;
+    std::vector<float> preintegrated;
+
   };
 
 } // ::ospray
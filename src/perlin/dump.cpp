@@ -6,10 +6,15 @@
 #include <fstream>
 #include <sstream>
 #include <math.h>
+#include <vector>
+#include <algorithm>
 #include <string>
 #include <sstream>
 
 #include "perlin.h"
+#include "Timer.h"
+#include "BrickFile.h"
+#include "AsyncWriter.h"
 
 #include "ospray/include/ospray/ospray.h"
 
@@ -25,15 +30,21 @@ syntax(char *a)
     cerr << "  -F frequency       noise frequency (8)\n";
 		cerr << "  -t dt nt           time series delta, number of timesteps (0, 1)\n";
     cerr << "  -P persistence     noise persistence (0.5)\n";
+    cerr << "  -T                 time the generator (voxels/sec); write nothing\n";
+    cerr << "  -B bx by bz        generate in bx x by x bz bricks and write .brk files\n";
+    cerr << "  -C megabytes       reuse lattice values across time steps (0)\n";
+    cerr << "  -U                 write with direct (uncached) I/O\n";
     exit(1);
 }
 
 int main(int argc, char *argv[])
 {
   int xsz = 512, ysz = 512, zsz = 512;
-  float t = 3.1415926;
-	float delta_t;
+	float delta_t = 0;
 	int nt = 1;
+	bool timing = false;
+	int bx = 0, by = 0, bz = 0;
+	bool direct = false;
 
   for (int i = 1; i < argc; i++)
     if (argv[i][0] == '-') 
@@ -46,6 +57,12 @@ int main(int argc, char *argv[])
 				case 'F': SetFrequency(atof(argv[++i])); break;
 				case 'O': SetOctaveCount(atoi(argv[++i])); break;
 				case 't': delta_t = atof(argv[++i]); nt = atoi(argv[++i]); break;
+				case 'T': timing = true; break;
+				case 'B': bx = atoi(argv[++i]);
+									by = atoi(argv[++i]);
+									bz = atoi(argv[++i]); break;
+				case 'C': SetTimeCache(atoi(argv[++i])); break;
+				case 'U': direct = true; break;
 				default:  syntax(argv[0]);
 			}
 		else
@@ -53,32 +70,103 @@ int main(int argc, char *argv[])
 
 	ospInit(&argc, (const char **)argv);
 
-	ofstream v("data.ser");
-	v << nt << "\n";
+	if (nt < 1 || (bx > 0 && (by <= 0 || bz <= 0)))
+		syntax(argv[0]);
 
 	size_t np = ((size_t)xsz)*((size_t)ysz)*((size_t)zsz);
-	float *scalars = new float[np];
+	float *scalars = (timing || bx > 0) ? new float[np] : NULL;
 
-	for (int i = 0; i < nt; i++)
+	if (timing)
 	{
-		PerlinT(scalars, xsz, ysz, zsz, i*delta_t);
+		// A small grid warms up the task system's threads without priming
+		// the time cache
+		float warm[8*8*8];
+		PerlinT(warm, 8, 8, 8, 0);
+
+		// With -C the cost per step varies: steps that move an octave into
+		// a new lattice cell pay to refill it, so the spread matters as
+		// much as the mean on a long series
+
+		double total = 0;
+		vector<double> steps;
+		for (int i = 0; i < nt; i++)
+		{
+			double t0 = WallClock();
+			PerlinT(scalars, xsz, ysz, zsz, i*delta_t);
+			double t1 = WallClock() - t0;
+			total += t1;
+			steps.push_back(t1);
+			cerr << "timestep " << i << ": " << t1 << " s, " << np / t1 << " voxels/sec\n";
+		}
+
+		sort(steps.begin(), steps.end());
+		cerr << nt << " timesteps of " << xsz << "x" << ysz << "x" << zsz << ": " << (nt * (double)np) / total << " voxels/sec\n";
+		cerr << "per timestep: mean " << total / nt << " s, median " << steps[nt / 2] << " s, max " << steps[nt - 1] << " s\n";
+		return 0;
+	}
+
+	// Bricks come out of the generator in file order, so they are
+	// written as they are with no re-bricking pass
+
+	if (bx > 0)
+	{
+		ofstream v("data.ser");
+		v << nt << "\n";
+
+		for (int i = 0; i < nt; i++)
+		{
+			ostringstream os;
+			os << i;
+
+			PerlinTBricked(scalars, xsz, ysz, zsz, i*delta_t, bx, by, bz);
+
+			string brick_name = string("timestep-") + os.str() + ".brk";
+			if (! BrickFile::Write(brick_name, "float", xsz, ysz, zsz, bx, by, bz, scalars, BRICK_RAW, 1, true))
+				exit(1);
 
+			v << brick_name << "\n";
+		}
+
+		v.close();
+		return 0;
+	}
+
+	// Otherwise each time step is made a slab of z planes at a time, each
+	// about a write chunk, and handed to the writer, which streams it out
+	// while the next slab is generated
+
+	const size_t chunk = 8 << 20;
+	size_t plane = ((size_t)xsz)*ysz;
+	int nz = std::max((size_t)1, chunk / (plane*sizeof(float)));
+	vector<float> slab(plane * nz);
+
+	AsyncWriter writer(chunk, 4, direct);
+
+	for (int i = 0; i < nt; i++)
+	{
 		ostringstream os;
 		os << i;
 		string raw_name = string("timestep-") + os.str() + ".raw";
-		
-		ofstream f(raw_name.c_str(), ofstream::binary);
-		f.write((char *)scalars, np*sizeof(float));
-		f.close();
-
-		string timestep_name = string("timestep-") + os.str() + ".vol";
-		v << timestep_name << "\n";
 
-		ofstream t(timestep_name.c_str());
-		t << xsz << " " << ysz << " " << zsz << " float " << raw_name << "\n";
-		t.close();
+		if (! writer.Begin(raw_name, xsz, ysz, zsz, "float"))
+		{
+			cerr << "unable to write " << raw_name << "\n";
+			exit(1);
+		}
+		for (int z0 = 0; z0 < zsz; z0 += nz)
+		{
+			int n = std::min(nz, zsz - z0);
+			PerlinTSlab(&slab[0], xsz, ysz, zsz, i*delta_t, z0, n);
+			if (! writer.Write(&slab[0], plane * n * sizeof(float)))
+			{
+				cerr << "unable to write " << raw_name << "\n";
+				exit(1);
+			}
+		}
+		writer.End();
 	}
 
-	v.close();
+	bool ok = writer.Finish("data.ser");
+	writer.Report(cerr);
+	return ok ? 0 : 1;
 }
-
@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
 #include "rvectors.h"
 
 #define DEFAULT_PERLIN_FREQUENCY 1.0
@@ -335,67 +340,467 @@ float Sample4D(float x, float y, float z, float t)
   return value;
 }
 
-void Perlin_task(float buf[], int xsz, int ysz, int zsz, int xstep, int ystep, int zstep, float d)
+// A row of Sample4D(x[i], y, z, t) for the x[i] of a row of the grid.
+// It goes octave by octave rather than point by point, so what depends
+// only on y, z and t (most of the lattice hash, the S-curves, the
+// distances to the lattice) is worked out once per row rather than per
+// point, and the loop over the row is straight-line code the compiler
+// can vectorize.  Each point sees exactly Sample4D's arithmetic, so the
+// results are the same.
+
+template <int quality> static inline float SCurve(float a)
 {
-	for (int ix = 0; ix < xsz; ix++)
-		for (int iy = 0; iy < ysz; iy++)
-			for (int iz = 0; iz < zsz; iz++)
-				buf[ix*xstep + iy*ystep + iz*zstep] = Sample3D(ix*d, iy*d, iz*d);
+  return quality == 0 ? a : quality == 1 ? SCurve3(a) : SCurve5(a);
 }
-	
-void Perlin(float buf[], int xsz, int ysz, int zsz)
+
+// g_randomVectors a component to a table; the compiler won't vectorize
+// gathers of the four neighbouring entries
+
+static float g_gradient[4][256];
+static bool  g_flatInT = true;
+
+static void SplitGradients()
+{
+  for (int i = 0; i < 256; i++)
+    for (int j = 0; j < 4; j++)
+      g_gradient[j][i] = g_randomVectors[(i << 2) + j];
+
+  for (int i = 0; i < 256; i++)
+    if (g_gradient[3][i] != 0.0)
+      g_flatInT = false;
+}
+
+static inline float Gradient4D(unsigned int h, float xp, float yp, float zp, float tp)
+{
+  // GradientNoise4D, from the lattice hash and the distance to the
+  // lattice point; only the low 8 bits of the hash matter, so wrapping
+  // unsigned arithmetic gives GradientNoise4D's table entry
+  h = (h ^ (h >> SHIFT_NOISE_GEN)) & 0xff;
+  return ((g_gradient[0][h] * xp)
+    + (g_gradient[1][h] * yp)
+    + (g_gradient[2][h] * zp)
+    + (g_gradient[3][h] * tp)) * 2.12;
+}
+
+// Time-coherent series (SetTimeCache).  The t components of the
+// gradient table are all zero (rvectors.h is a 3D table padded to four),
+// so an octave's noise at t depends on t only through which lattice cell
+// t is in and how far across it, ts.  While t stays in one cell of an
+// octave, the octave's share of a voxel is LinearInterp(iz0, iz1, ts)
+// with the same iz0 and iz1 every time step.  Those are kept for every
+// voxel (8 bytes a voxel an octave), so a time step then costs a lerp a
+// voxel rather than sixteen gradients, and are worked out again when t
+// enters a new cell.  Octaves are cached from the lowest, which change
+// cells least often, as many as fit in the budget; an octave that the
+// last step moved a cell or more is done directly.  Results are the
+// same as Sample4D's.
+
+enum { OCTAVE_DIRECT, OCTAVE_FILL, OCTAVE_CACHED };
+
+struct OctaveCache
+{
+  int mode;
+  float *c;           // iz0 then iz1 of each row, 2 floats a voxel
+};
+
+static size_t m_timeCacheBytes = 0;
+
+void SetTimeCache(int megabytes) { m_timeCacheBytes = ((size_t)std::max(megabytes, 0)) << 20; }
+
+template <int quality> static void Sample4DRow(float *__restrict__ out, float *__restrict__ x, int n, float y, float z, float t,
+                                               const OctaveCache *cache, size_t r, float *scratch)
+{
+  float curPersistence = 1.0;
+
+  y *= m_frequency;
+  z *= m_frequency;
+  t *= m_frequency;
+
+  for (int i = 0; i < n; i++)
+  {
+    out[i] = 0.0;
+    x[i] *= m_frequency;
+  }
+
+  for (int curOctave = 0; curOctave < m_octaveCount; curOctave++) {
+
+    float ny = MakeInt32Range (y);
+    float nz = MakeInt32Range (z);
+    float nt = MakeInt32Range (t);
+
+    int y0 = (ny > 0.0? (int)ny: (int)ny - 1), y1 = y0 + 1;
+    int z0 = (nz > 0.0? (int)nz: (int)nz - 1), z1 = z0 + 1;
+    int t0 = (nt > 0.0? (int)nt: (int)nt - 1), t1 = t0 + 1;
+
+    float ys = SCurve<quality>(ny - (float)y0);
+    float zs = SCurve<quality>(nz - (float)z0);
+    float ts = SCurve<quality>(nt - (float)t0);
+
+    float yp0 = ny - (float)y0, yp1 = ny - (float)y1;
+    float zp0 = nz - (float)z0, zp1 = nz - (float)z1;
+    float tp0 = nt - (float)t0, tp1 = nt - (float)t1;
+
+    // The lattice hash less its x term, for each y, z, t corner
+    unsigned int seed = (m_seed + curOctave) & 0xffffffff;
+    unsigned int h[2][2][2];
+    for (int b = 0; b < 2; b++)
+      for (int c = 0; c < 2; c++)
+        for (int d = 0; d < 2; d++)
+          h[b][c][d] = (unsigned int)Y_NOISE_GEN * (unsigned int)(y0 + b)
+                     + (unsigned int)Z_NOISE_GEN * (unsigned int)(z0 + c)
+                     + (unsigned int)T_NOISE_GEN * (unsigned int)(t0 + d)
+                     + (unsigned int)SEED_NOISE_GEN * seed;
+
+    // MakeInt32Range leaves x alone unless it's huge, and the row loop
+    // vectorizes only without the branches
+    float xmax = 0;
+    for (int i = 0; i < n; i++)
+      xmax = std::max(xmax, fabsf(x[i]));
+
+    if (xmax >= 1073741824.0)
+      for (int i = 0; i < n; i++)
+        x[i] = MakeInt32Range(x[i]);
+
+    int mode = cache ? cache[curOctave].mode : OCTAVE_DIRECT;
+
+    if (mode == OCTAVE_CACHED)
+    {
+      const float *c0 = cache[curOctave].c + 2*r, *c1 = c0 + n;
+      for (int i = 0; i < n; i++)
+        out[i] += LinearInterp(c0[i], c1[i], ts) * curPersistence;
+    }
+    else
+    {
+      // iz0 and iz1 always go to scratch (2n floats), and from there to the
+      // cache if it's being filled; the loop doesn't vectorize with the
+      // store conditional or its target varying
+      float *__restrict__ c0 = scratch, *__restrict__ c1 = scratch + n;
+
+      for (int i = 0; i < n; i++)
+      {
+        float nx = x[i];
+        int x0 = (int)nx - (nx > 0.0 ? 0 : 1), x1 = x0 + 1;
+        float xs = SCurve<quality>(nx - (float)x0);
+        float xp0 = nx - (float)x0, xp1 = nx - (float)x1;
+        unsigned int hx0 = (unsigned int)X_NOISE_GEN * (unsigned int)x0;
+        unsigned int hx1 = (unsigned int)X_NOISE_GEN * (unsigned int)x1;
+
+        float n0, n1, ix0, ix1, iy0, iy1;
+
+        n0   = Gradient4D (h[0][0][0] + hx0, xp0, yp0, zp0, tp0);
+        n1   = Gradient4D (h[0][0][0] + hx1, xp1, yp0, zp0, tp0);
+        ix0  = LinearInterp (n0, n1, xs);
+        n0   = Gradient4D (h[1][0][0] + hx0, xp0, yp1, zp0, tp0);
+        n1   = Gradient4D (h[1][0][0] + hx1, xp1, yp1, zp0, tp0);
+        ix1  = LinearInterp (n0, n1, xs);
+        iy0  = LinearInterp (ix0, ix1, ys);
+        n0   = Gradient4D (h[0][1][0] + hx0, xp0, yp0, zp1, tp0);
+        n1   = Gradient4D (h[0][1][0] + hx1, xp1, yp0, zp1, tp0);
+        ix0  = LinearInterp (n0, n1, xs);
+        n0   = Gradient4D (h[1][1][0] + hx0, xp0, yp1, zp1, tp0);
+        n1   = Gradient4D (h[1][1][0] + hx1, xp1, yp1, zp1, tp0);
+        ix1  = LinearInterp (n0, n1, xs);
+        iy1  = LinearInterp (ix0, ix1, ys);
+        float iz0 = LinearInterp (iy0, iy1, zs);
+
+        n0   = Gradient4D (h[0][0][1] + hx0, xp0, yp0, zp0, tp1);
+        n1   = Gradient4D (h[0][0][1] + hx1, xp1, yp0, zp0, tp1);
+        ix0  = LinearInterp (n0, n1, xs);
+        n0   = Gradient4D (h[1][0][1] + hx0, xp0, yp1, zp0, tp1);
+        n1   = Gradient4D (h[1][0][1] + hx1, xp1, yp1, zp0, tp1);
+        ix1  = LinearInterp (n0, n1, xs);
+        iy0  = LinearInterp (ix0, ix1, ys);
+        n0   = Gradient4D (h[0][1][1] + hx0, xp0, yp0, zp1, tp1);
+        n1   = Gradient4D (h[0][1][1] + hx1, xp1, yp0, zp1, tp1);
+        ix0  = LinearInterp (n0, n1, xs);
+        n0   = Gradient4D (h[1][1][1] + hx0, xp0, yp1, zp1, tp1);
+        n1   = Gradient4D (h[1][1][1] + hx1, xp1, yp1, zp1, tp1);
+        ix1  = LinearInterp (n0, n1, xs);
+        iy1  = LinearInterp (ix0, ix1, ys);
+        float iz1 = LinearInterp (iy0, iy1, zs);
+
+        c0[i] = iz0;
+        c1[i] = iz1;
+
+        out[i] += LinearInterp(iz0, iz1, ts) * curPersistence;
+      }
+
+      if (mode == OCTAVE_FILL)
+        memcpy(cache[curOctave].c + 2*r, scratch, 2 * n * sizeof(float));
+    }
+
+    for (int i = 0; i < n; i++)
+      x[i] *= m_lacunarity;
+
+    y *= m_lacunarity;
+    z *= m_lacunarity;
+    t *= m_lacunarity;
+    curPersistence *= m_persistence;
+  }
+}
+
+// The grid is filled by tasks on the bundled task system (tasksys.cpp),
+// as perlin.ispc does.  The output is x-fastest, as Volume::Import and
+// OSPRay read it, either as one block or cut into bricks laid out the
+// way a raw .brk file (BrickFile.h) stores them: each brick x-fastest
+// and contiguous, bricks in x-fastest order over the brick grid, edge
+// bricks clipped.  A task does one z plane of a row of bricks, so every
+// row it writes is a unit stride run of x.  A call can do just planes z0
+// on of the volume (whole layers of bricks), into a buffer that starts
+// at plane z0, so a volume can be made and written out a slab at a time.
+
+extern "C" {
+  void ISPCLaunch(void **handlePtr, void *f, void *data, int countx, int county, int countz);
+  void ISPCSync(void *handle);
+}
+
+struct PerlinArgs
+{
+  float *buf;
+  int xsz, ysz, zsz;
+  int bx, by, bz;
+  int nbx, nby;
+  int z0;
+  size_t base;        // where buf is in the whole volume
+  float t, d;
+  OctaveCache *cache;
+};
+
+// Where plane iz of brick row (j, k) starts, how wide its bricks are
+// and how far apart its rows are.  Bricks before (i, j, k) fill whole z
+// layers, then whole rows of the layer, then part of a row.
+
+static size_t BrickPlane(PerlinArgs *a, int i, int j, int iz, int& w, int& h)
+{
+  int k = iz / a->bz;
+  int d = std::min(a->bz, a->zsz - k*a->bz);
+  w = std::min(a->bx, a->xsz - i*a->bx);
+  h = std::min(a->by, a->ysz - j*a->by);
+
+  return (size_t)a->xsz * a->ysz * k * a->bz
+       + (size_t)a->xsz * j * a->by * d
+       + (size_t)i * a->bx * h * d
+       + (size_t)w * h * (iz - k*a->bz);
+}
+
+static void Perlin_task(void *data, int threadIndex, int threadCount, int taskIndex, int taskCount,
+                        int, int, int, int, int, int)
 {
-	float d = 1.0 / (xsz > ysz)
-                            ?
-                            (xsz > zsz)
-                              ?
-                              xsz
-                              :
-                              zsz
-                            :
-                            (ysz > zsz)
-                              ?
-                              ysz
-                              :
-                              zsz;
-
-	int xstep = ysz*zsz;
-	int ystep = zsz;
-	int zstep = 1;
-
-	Perlin_task(buf, xsz, ysz, zsz, xstep, ystep, zstep, d);
+  PerlinArgs *a = (PerlinArgs *)data;
+
+  int iz = a->z0 + taskIndex / a->nby;
+  int j  = taskIndex % a->nby;
+
+  for (int i = 0; i < a->nbx; i++)
+  {
+    int w, h;
+    float *plane = a->buf + (BrickPlane(a, i, j, iz, w, h) - a->base);
+
+    for (int y = 0; y < h; y++)
+    {
+      float *row = plane + (size_t)y * w;
+      int iy = j*a->by + y;
+      for (int x = 0; x < w; x++)
+        row[x] = Sample3D((i*a->bx + x)*a->d, iy*a->d, iz*a->d);
+    }
+  }
+}
+
+static void PerlinT_task(void *data, int threadIndex, int threadCount, int taskIndex, int taskCount,
+                         int, int, int, int, int, int)
+{
+  PerlinArgs *a = (PerlinArgs *)data;
+
+  int iz = a->z0 + taskIndex / a->nby;
+  int j  = taskIndex % a->nby;
+
+  std::vector<float> x(a->bx), scratch(2 * a->bx);
+
+  for (int i = 0; i < a->nbx; i++)
+  {
+    int w, h;
+    float *plane = a->buf + (BrickPlane(a, i, j, iz, w, h) - a->base);
+
+    for (int y = 0; y < h; y++)
+    {
+      for (int ix = 0; ix < w; ix++)
+        x[ix] = (i*a->bx + ix)*a->d;
+
+      float *row = plane + (size_t)y * w;
+      size_t r = (row - a->buf) + a->base;
+      int iy = j*a->by + y;
+      switch (m_noiseQuality) {
+        case 0:  Sample4DRow<0>(row, &x[0], w, iy*a->d, iz*a->d, a->t, a->cache, r, &scratch[0]); break;
+        case 1:  Sample4DRow<1>(row, &x[0], w, iy*a->d, iz*a->d, a->t, a->cache, r, &scratch[0]); break;
+        default: Sample4DRow<2>(row, &x[0], w, iy*a->d, iz*a->d, a->t, a->cache, r, &scratch[0]); break;
+      }
+    }
+  }
+}
+
+// What the time cache holds: the grid and noise it was made for, and
+// which t cell each octave's entries are for
+
+struct TimeCacheKey
+{
+  int xsz, ysz, zsz, bx, by, bz;
+  int quality, seed, octaves;
+  float frequency, lacunarity;
+};
+
+static TimeCacheKey       g_cacheKey;
+static std::vector<float> g_cache[PERLIN_MAX_OCTAVE];
+static int                g_cacheCell[PERLIN_MAX_OCTAVE];
+static bool               g_cacheValid[PERLIN_MAX_OCTAVE];
+static OctaveCache        g_octaves[PERLIN_MAX_OCTAVE];
+static float              g_lastT;
+static bool               g_haveLastT = false;
+
+static OctaveCache *PrepareTimeCache(PerlinArgs& a)
+{
+  size_t np = (size_t)a.xsz * a.ysz * a.zsz;
+  size_t bytes = 2 * np * sizeof(float);
+  int octaves = std::min(m_octaveCount, PERLIN_MAX_OCTAVE);
+  int ncached = g_flatInT ? std::min((size_t)octaves, m_timeCacheBytes / bytes) : 0;
+
+  TimeCacheKey key;
+  memset(&key, 0, sizeof(key));
+  key.xsz = a.xsz; key.ysz = a.ysz; key.zsz = a.zsz;
+  key.bx = a.bx; key.by = a.by; key.bz = a.bz;
+  key.quality = m_noiseQuality; key.seed = m_seed; key.octaves = m_octaveCount;
+  key.frequency = m_frequency; key.lacunarity = m_lacunarity;
+
+  if (memcmp(&key, &g_cacheKey, sizeof(key)))
+  {
+    g_cacheKey = key;
+    g_haveLastT = false;
+    for (int o = 0; o < PERLIN_MAX_OCTAVE; o++)
+      g_cacheValid[o] = false;
+  }
+
+  for (int o = ncached; o < PERLIN_MAX_OCTAVE; o++)
+  {
+    std::vector<float>().swap(g_cache[o]);
+    g_cacheValid[o] = false;
+  }
+
+  if (! ncached)
+    return NULL;
+
+  // t as Sample4DRow sees it, octave by octave
+
+  float t = a.t * m_frequency;
+  float step = g_haveLastT ? fabsf(a.t - g_lastT) * m_frequency : 0;
+
+  for (int o = 0; o < octaves; o++)
+  {
+    float nt = MakeInt32Range (t);
+    int t0 = (nt > 0.0? (int)nt: (int)nt - 1);
+
+    OctaveCache& oc = g_octaves[o];
+    if (o >= ncached || step >= 1.0)
+    {
+      oc.mode = OCTAVE_DIRECT;
+      g_cacheValid[o] = false;
+    }
+    else
+    {
+      g_cache[o].resize(2 * np);
+      oc.mode = g_cacheValid[o] && g_cacheCell[o] == t0 ? OCTAVE_CACHED : OCTAVE_FILL;
+      oc.c = &g_cache[o][0];
+      g_cacheCell[o] = t0;
+    }
+
+    t *= m_lacunarity;
+    step *= m_lacunarity;
+  }
+
+  return g_octaves;
+}
+
+static void FinishTimeCache(PerlinArgs& a)
+{
+  for (int o = 0; o < std::min(m_octaveCount, PERLIN_MAX_OCTAVE); o++)
+    if (g_octaves[o].mode == OCTAVE_FILL)
+      g_cacheValid[o] = true;
+
+  g_lastT = a.t;
+  g_haveLastT = true;
 }
 
-void PerlinT_task(float buf[], int xsz, int ysz, int zsz, float t, int xstep, int ystep, int zstep, float d)
+// A volume made a slab at a time shares one set of cache modes: they're
+// chosen with its first slab and the cache is good once its last is done
+
+static bool  g_slabsPending = false;
+static float g_slabsT;
+
+static void Launch(void *task, float buf[], int xsz, int ysz, int zsz, float t, int bx, int by, int bz,
+                   int z0, int nz)
 {
-	for (int ix = 0; ix < xsz; ix++)
-		for (int iy = 0; iy < ysz; iy++)
-			for (int iz = 0; iz < zsz; iz++)
-				buf[ix*xstep + iy*ystep + iz*zstep] = Sample4D(ix*d, iy*d, iz*d, t);
+  PerlinArgs a;
+  a.buf = buf;
+  a.xsz = xsz; a.ysz = ysz; a.zsz = zsz;
+  a.bx = std::max(1, std::min(bx, xsz));
+  a.by = std::max(1, std::min(by, ysz));
+  a.bz = std::max(1, std::min(bz, zsz));
+  a.nbx = (xsz + a.bx - 1) / a.bx;
+  a.nby = (ysz + a.by - 1) / a.by;
+  a.z0 = z0;
+  a.base = (size_t)xsz * ysz * z0;
+  a.t = t;
+  a.d = 1.0 / std::max(std::max(xsz, ysz), zsz);
+
+  static bool split = false;
+  if (! split)
+  {
+    SplitGradients();
+    split = true;
+  }
+
+  a.cache = NULL;
+  if (task == (void *)PerlinT_task)
+  {
+    if (z0 == 0)
+    {
+      a.cache = PrepareTimeCache(a);
+      g_slabsPending = a.cache != NULL;
+      g_slabsT = t;
+    }
+    else if (g_slabsPending && g_slabsT == t)
+      a.cache = g_octaves;
+  }
+
+  void *handle = NULL;
+  ISPCLaunch(&handle, task, (void *)&a, nz * a.nby, 1, 1);
+  ISPCSync(handle);
+
+  if (a.cache && z0 + nz == zsz)
+  {
+    FinishTimeCache(a);
+    g_slabsPending = false;
+  }
 }
-	
+
+void Perlin(float buf[], int xsz, int ysz, int zsz)
+{
+  Launch((void *)Perlin_task, buf, xsz, ysz, zsz, 0.0, xsz, ysz, zsz, 0, zsz);
+}
+
 void PerlinT(float buf[], int xsz, int ysz, int zsz, float t)
 {
-	float d = 1.0 / (xsz > ysz)
-														?
-														(xsz > zsz) 
-															?
-															xsz
-															:
-															zsz
-														:
-														(ysz > zsz) 
-															?
-															ysz
-															:
-															zsz;
-																
-
-
-	int xstep = ysz*zsz;
-	int ystep = zsz;
-	int zstep = 1;
-
-	PerlinT_task(buf, xsz, ysz, zsz, t, xstep, ystep, zstep, d);
+  Launch((void *)PerlinT_task, buf, xsz, ysz, zsz, t, xsz, ysz, zsz, 0, zsz);
+}
+
+void PerlinTBricked(float buf[], int xsz, int ysz, int zsz, float t, int bx, int by, int bz)
+{
+  Launch((void *)PerlinT_task, buf, xsz, ysz, zsz, t, bx, by, bz, 0, zsz);
+}
+
+void PerlinTSlab(float buf[], int xsz, int ysz, int zsz, float t, int z0, int nz)
+{
+  nz = std::min(nz, zsz - z0);
+  if (z0 < 0 || nz <= 0)
+    return;
+
+  Launch((void *)PerlinT_task, buf, xsz, ysz, zsz, t, xsz, ysz, zsz, z0, nz);
 }
-	
@@ -1,3 +1,13 @@
+// Volumes are generated x-fastest, the order Volume::Import reads.
+// PerlinTBricked cuts the volume into bx x by x bz bricks, in the
+// layout of a raw .brk file (BrickFile.h).  PerlinTSlab makes planes
+// z0 to z0+nz-1 of PerlinT's volume into buf, so a volume can be made and
+// written out a slab at a time (in order, from z0 = 0).
+//
+// SetTimeCache lets PerlinT keep up to that many megabytes of per-voxel
+// lattice values (8 bytes a voxel an octave) so that a series of close
+// time steps mostly reuses them; 0, the default, turns it off.
+
 #if WITH_ISPC == 1
 #include "perlin_ispc.h"
 using namespace ispc;
@@ -8,7 +18,10 @@ void SetQuality(int q);
 void SetOctaveCount(int o);
 void SetPersistence(float p);
 void SetSeed(int s);
+void SetTimeCache(int megabytes);
 void PerlinT(float buf[], int xsz, int ysz, int zsz, float t);
+void PerlinTBricked(float buf[], int xsz, int ysz, int zsz, float t, int bx, int by, int bz);
+void PerlinTSlab(float buf[], int xsz, int ysz, int zsz, float t, int z0, int nz);
 #endif
 
 
@@ -6,9 +6,12 @@
 #include <fstream>
 #include <sstream>
 #include <math.h>
+#include <pthread.h>
 
+#include "AsyncWriter.h"
 #include "Cinema.h"
 #include "perlin.h"
+#include "Trace.h"
 
 using namespace std;
 
@@ -22,15 +25,59 @@ syntax(char *a)
     cerr << "  -f frequency       noise frequency (8)\n";
     cerr << "  -P persistence     noise persistence (0.5)\n";
     cerr << "  -t dt nt           time series delta, number of timesteps (0, 1)\n";
+    cerr << "  -C megabytes       reuse lattice values across time steps (0)\n";
     cerr << "  -s w h           	size of output images\n";
 		cerr << "  -F                 save state files (first time step)\n";
 		cerr << "  -D                 save each time step volume\n";
+		cerr << "  -U                 write saved volumes with direct I/O\n";
 #if WITH_OPENGL == TRUE
 		cerr << "  -S                 show images as they are rendered\n";
 #endif
     exit(1);
 }
 
+// One time step: the buffer it lives in and where it came from
+
+struct Step
+{
+	float	*scalars;
+	int		xsz, ysz, zsz;
+	float	time;
+	int		t;
+	AsyncWriter *writer;
+	bool	written;
+};
+
+void *
+generate(void *p)
+{
+	Step *s = (Step *)p;
+
+	TraceScope trace(TRACE_SIM_GENERATE);
+	PerlinT(s->scalars, s->xsz, s->ysz, s->zsz, s->time);
+	return NULL;
+}
+
+void *
+write_step(void *p)
+{
+	Step *s = (Step *)p;
+
+	// The writer copies the step into its own chunks and queues them,
+	// so this returns once the buffer is free rather than once it's on
+	// disk; the writer times the disk writes itself
+
+	char rawname[256];
+	sprintf(rawname, "data_%05d.raw", s->t);
+	s->written = s->writer->Begin(rawname, s->xsz, s->ysz, s->zsz, "float") &&
+		s->writer->Write(s->scalars, ((size_t)s->xsz)*s->ysz*s->zsz*sizeof(float));
+	s->writer->End();
+
+	if (! s->written)
+		std::cerr << "unable to write " << rawname << "\n";
+	return NULL;
+}
+
 CameraVariable *
 cinema_setup(Renderer& renderer, Cinema& cinema)
 {
@@ -111,6 +158,7 @@ int main(int argc, char *argv[])
 	CameraVariable *camvar = NULL;
 	bool saveState = false;
 	bool dump = false;
+	bool direct = false;
 #if WITH_OPENGL == TRUE
   bool show = false;
 #endif
@@ -127,12 +175,14 @@ int main(int argc, char *argv[])
 #endif
 				case 'F': saveState = true; break;
 				case 'D': dump = true; break;
+				case 'U': direct = true; break;
 				case 's': width = atoi(argv[++i]);
 									height = atoi(argv[++i]); break;
 				case 'P': SetPersistence(atof(argv[++i])); break;
 				case 'f': SetFrequency(atof(argv[++i])); break;
 				case 'O': SetOctaveCount(atoi(argv[++i])); break;
 				case 't': delta_t = atof(argv[++i]); nt = atoi(argv[++i]); break;
+				case 'C': SetTimeCache(atoi(argv[++i])); break;
 				default:  syntax(argv[0]);
 			}
 		else if (filename == NULL)
@@ -150,18 +200,76 @@ int main(int argc, char *argv[])
 	renderer.LoadState(std::string(filename), false);
 	camvar = cinema_setup(renderer, cinema);
 
+	// Two time steps are in flight: while step t is rendered out of one
+	// buffer, step t+1 is generated into the other and step t is written
+	// out by its own thread.  The volume is switched between the buffers
+	// with SetVoxels, so the OSPRay volume is never rebuilt.
+
 	int np = xsz*ysz*zsz;
-	float *scalars = new float[np];
+	float *scalars[2] = { new float[np], new float[np] };
 
-	renderer.getVolume()->Attach(std::string("float"), xsz, ysz, zsz, (void *)scalars, renderer.getTransferFunction());
+	Step gen = { scalars[0], xsz, ysz, zsz, 0, 0 };
+	generate(&gen);
+
+	renderer.getVolume()->Attach(std::string("float"), xsz, ysz, zsz, (void *)scalars[0], renderer.getTransferFunction());
 	renderer.CommitVolume();
 
+	AsyncWriter writer(8 << 20, 4, direct);
+
+	Step dmp;
+	pthread_t genThread, dmpThread;
+	bool dumping = false;
+	bool dumpFailed = false;
+
   for (int t = 0; t < nt; t++)
   {
-		PerlinT(scalars, xsz, ysz, zsz, t*delta_t);
-		fprintf(stderr, "%f\n", scalars[12345]);
+		float *current = scalars[t & 1];
+		fprintf(stderr, "%f\n", current[12345]);
+
+		if (t > 0)
+		{
+			renderer.getVolume()->SetVoxels((void *)current);
+			renderer.getVolume()->commit();
+		}
 
-		renderer.getVolume()->commit(true);
+		// The other buffer holds step t-1, which may still be being
+		// written; it is free for step t+1 once that's done
+
+		if (dumping)
+		{
+			pthread_join(dmpThread, NULL);
+			dumping = false;
+			dumpFailed = dumpFailed || ! dmp.written;
+		}
+
+		// Once a write has failed the rest of the series is no use, so
+		// stop dumping but carry on rendering
+
+		if (dump && ! dumpFailed)
+		{
+			Step s = { current, xsz, ysz, zsz, 0, t, &writer, false };
+			dmp = s;
+			if (pthread_create(&dmpThread, NULL, write_step, (void *)&dmp))
+			{
+				write_step((void *)&dmp);
+				dumpFailed = ! dmp.written;
+			}
+			else
+				dumping = true;
+		}
+
+		bool generating = false;
+		if (t + 1 < nt)
+		{
+			Step s = { scalars[(t + 1) & 1], xsz, ysz, zsz, (t + 1)*delta_t, t + 1 };
+			gen = s;
+			if (pthread_create(&genThread, NULL, generate, (void *)&gen))
+			{
+				std::cerr << "unable to start generator thread\n";
+				exit(1);
+			}
+			generating = true;
+		}
 
 		camvar->ResetCount();
 
@@ -170,23 +278,26 @@ int main(int argc, char *argv[])
 
 		std::cerr << "timestep " << t << " done\n";
 
-		if (dump)
-		{
-			char rawname[256];
-			sprintf(rawname, "data_%05d.raw", t);
-			ofstream f(rawname, ofstream::binary);
-			f.write((char *)scalars, np*sizeof(float));
-			f.close();
-
-			char volname[256];
-			sprintf(volname, "data_%05d.vol", t);
-			ofstream v(volname);
-			v << xsz << " " << ysz << " " << zsz << " float " << rawname << "\n";
-			v.close();
-			std::cerr << "wrote: " << volname << " " << rawname << "\n";
-		}
+		if (generating)
+			pthread_join(genThread, NULL);
+	}
+
+	if (dumping)
+	{
+		pthread_join(dmpThread, NULL);
+		dumpFailed = dumpFailed || ! dmp.written;
+	}
+
+	if (dump)
+	{
+		if (! writer.Finish("data.ser"))
+			dumpFailed = true;
+		writer.Report(std::cerr);
 	}
 
 	cinema.WriteInfo();
+	ReportTrace(std::cerr);
+
+	return dumpFailed ? 1 : 0;
 }
 
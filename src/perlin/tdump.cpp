@@ -7,7 +7,11 @@
 #include <sstream>
 #include <math.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "perlin.h"
+#include "AsyncWriter.h"
 
 using namespace std;
 
@@ -22,6 +26,7 @@ syntax(char *a)
     cerr << "  -P persistence     noise persistence (0.5)\n";
     cerr << "  -t dt nt           time series delta, number of timesteps (0, 1)\n";
     cerr << "  -s w h           	size of output images\n";
+    cerr << "  -U                 write with direct (uncached) I/O\n";
     exit(1);
 }
 
@@ -34,6 +39,7 @@ int main(int argc, char *argv[])
   int   nt = 1;
 	char *filename = NULL;
 	bool dump_data = false;
+	bool direct = false;
 
   for (int i = 1; i < argc; i++)
     if (argv[i][0] == '-') 
@@ -49,6 +55,7 @@ int main(int argc, char *argv[])
 				case 'O': SetOctaveCount(atoi(argv[++i])); break;
 				case 't': delta_t = atof(argv[++i]); nt = atoi(argv[++i]); break;
 				case 'D': dump_data = true; break;
+				case 'U': direct = true; break;
 				default:  syntax(argv[0]);
 			}
 		else if (filename == NULL)
@@ -56,20 +63,43 @@ int main(int argc, char *argv[])
 		else
 			syntax(argv[0]);
 
-	int np = xsz*ysz*zsz;
-	float *scalars = new float[np];
+	// Time steps are made a slab of z planes at a time and streamed out
+	// by the writer while the next slab is generated
+
+	const size_t chunk = 8 << 20;
+	size_t plane = ((size_t)xsz)*ysz;
+	int nz = std::max((size_t)1, chunk / (plane*sizeof(float)));
+	vector<float> slab(plane * nz);
+
+	AsyncWriter writer(chunk, 4, direct);
 
   for (int t = 0; t < nt; t++)
   {
-		PerlinT(scalars, xsz, ysz, zsz, t*delta_t);
-
 		char fname[256];
 		sprintf(fname, "timestep_%04d.raw", t);
-		ofstream f(fname, ofstream::binary);
-		f.write((char *)scalars, np*sizeof(float));
-		f.close();
+
+		if (! writer.Begin(fname, xsz, ysz, zsz, "float"))
+		{
+			std::cerr << "unable to write " << fname << "\n";
+			exit(1);
+		}
+		for (int z0 = 0; z0 < zsz; z0 += nz)
+		{
+			int n = std::min(nz, zsz - z0);
+			PerlinTSlab(&slab[0], xsz, ysz, zsz, t*delta_t, z0, n);
+			if (! writer.Write(&slab[0], plane * n * sizeof(float)))
+			{
+				std::cerr << "unable to write " << fname << "\n";
+				exit(1);
+			}
+		}
+		writer.End();
 
 		std::cerr << "timestep " << t << " done\n";
 	}
+
+	bool ok = writer.Finish("data.ser");
+	writer.Report(std::cerr);
+	return ok ? 0 : 1;
 }
 
@@ -25,6 +25,7 @@
 
 #include "../common/common.h"
 #include "../common/mypng.h"
+#include "Pyramid.h"
 
 QOSPRayWindow::QOSPRayWindow(QMainWindow *parent, 
                              OSPRenderer renderer, 
@@ -36,9 +37,30 @@ QOSPRayWindow::QOSPRayWindow(QMainWindow *parent,
     rotationRate(0.f), 
     benchmarkWarmUpFrames(0), 
     benchmarkFrames(0), 
-    frameBuffer(NULL)
+    frameBuffer(NULL),
+    volume(NULL),
+    progressivePasses(32),
+    refinePass(0),
+    refining(false),
+    fullModel(NULL),
+    coarseModel(NULL),
+    mesh(NULL),
+    coarseTried(false),
+    interacting(false),
+    lodIdle(200)
 {
   this->renderer = renderer;
+
+	// Refinement passes after each change (0: render every frame in full)
+	const char *e = getenv("VOLVIEWER_PROGRESSIVE");
+	if (e)
+		progressivePasses = atoi(e);
+
+	// Milliseconds without mouse movement before a drag is over
+	e = getenv("VOLVIEWER_LOD_IDLE");
+	if (e)
+		lodIdle = atoi(e);
+
 	setFocusPolicy(Qt::StrongFocus);
 	cameraEditor.getCamera()->setRenderer(renderer);
 	cameraEditor.setWindow(this);
@@ -48,6 +70,8 @@ QOSPRayWindow::~QOSPRayWindow()
 {
   if(frameBuffer)
 		ospFreeFrameBuffer(frameBuffer);
+	if (fullModel) ospRelease(fullModel);
+	if (coarseModel) ospRelease(coarseModel);
 }
 
 void
@@ -93,6 +117,9 @@ void QOSPRayWindow::setBenchmarkParameters(int benchmarkWarmUpFrames, int benchm
 
 void QOSPRayWindow::paintGL()
 {
+	bool refinement = refining;
+	refining = false;
+
   Clear();
   if(!renderingEnabled || !frameBuffer || !renderer)
     {
@@ -106,11 +133,31 @@ void QOSPRayWindow::paintGL()
       benchmarkTimer.start();
     }
 
-	ospCommit(renderer);
+	// Paged volumes keep loading in the background; repaint until the
+	// visible bricks are all in
+
+	if (volume && ! volume->UpdateView(*cameraEditor.getCamera()))
+		QTimer::singleShot(100, this, SLOT(updateGL()));
+
+	// Progressive refinement: every repaint for a change commits, which
+	// restarts it with a cheap preview.  While nothing changes, refinement
+	// passes are rendered without a commit, each adding samples to the
+	// pixels that haven't converged yet.
+
+	bool progressive = progressivePasses > 0 && rotationRate == 0.f && benchmarkFrames == 0;
+
+	if (! refinement)
+	{
+		ospSet1i(renderer, "progressive", progressive ? 1 : 0);
+		ospCommit(renderer);
+		refinePass = 0;
+	}
 
   renderFrameTimer.start();
 
+	if (volume) volume->BeginRender();
   ospRenderFrame(frameBuffer, renderer);
+	if (volume) volume->EndRender();
 
   double framesPerSecond = 1000.0 / renderFrameTimer.elapsed();
   char title[1024];  sprintf(title, "OSPRay Volume Viewer (%.4f fps)", framesPerSecond);
@@ -131,6 +178,12 @@ void QOSPRayWindow::paintGL()
   // increment frame counter
   frameCount++;
 
+	if (progressive && ! interacting && refinePass < progressivePasses)
+	{
+		refinePass++;
+		refineTimer.start(0, this);
+	}
+
   // quit if we're benchmarking and have exceeded the needed number of frames
   if(benchmarkFrames > 0 && frameCount >= benchmarkWarmUpFrames + benchmarkFrames)
     {
@@ -148,6 +201,110 @@ void QOSPRayWindow::paintGL()
     }
 }
 
+void QOSPRayWindow::timerEvent(QTimerEvent *event)
+{
+	if (event->timerId() == lodTimer.timerId())
+	{
+		endInteraction();
+		return;
+	}
+
+	if (event->timerId() != refineTimer.timerId())
+	{
+		QGLWidget::timerEvent(event);
+		return;
+	}
+
+	refineTimer.stop();
+	refining = true;
+	updateGL();
+}
+
+void QOSPRayWindow::finishRefinement()
+{
+	endInteraction();
+	while (refineTimer.isActive())
+	{
+		refineTimer.stop();
+		refining = true;
+		updateGL();
+	}
+}
+
+void QOSPRayWindow::setModel(OSPModel full, OSPTriangleMesh m)
+{
+	lodTimer.stop();
+	interacting = false;
+
+	if (fullModel && fullModel != full) ospRelease(fullModel);
+	if (coarseModel) ospRelease(coarseModel);
+
+	fullModel = full;
+	coarseModel = NULL;
+	mesh = m;
+	coarseTried = false;
+}
+
+// Coarse levels for rendering while the camera is dragged: VOLVIEWER_LOD
+// levels (by default enough to bring the coarsest to about 128^3, at
+// most 4; 0 for none), cached next to the data if VOLVIEWER_LOD_CACHE is
+// set.  The coarsest level is the one rendered.  Built on the first drag
+// rather than as each time step is shown, so stepping through a series
+// doesn't wait on them.
+
+void QOSPRayWindow::buildCoarseModel()
+{
+	coarseTried = true;
+	if (! volume)
+		return;
+
+	int x, y, z;
+	volume->GetDimensions(x, y, z);
+
+	const char *e = getenv("VOLVIEWER_LOD");
+	int levels = e ? atoi(e) : PyramidDepth(x, y, z, 1 << 21, 4);
+
+	volume->BuildPyramid(levels, getenv("VOLVIEWER_LOD_CACHE") != NULL);
+	if (volume->GetNumberOfLevels() < 2)
+		return;
+
+	coarseModel = ospNewModel();
+	if (mesh) ospAddGeometry(coarseModel, mesh);
+	ospAddVolume(coarseModel, volume->GetLevel(volume->GetNumberOfLevels() - 1)->getOSPVolume());
+	ospCommit(coarseModel);
+}
+
+// While the camera is being dragged, render the coarse model; input
+// going idle (or the button coming up) puts the full one back
+
+void QOSPRayWindow::startInteraction()
+{
+	if (! coarseTried)
+		buildCoarseModel();
+
+	if (! coarseModel)
+		return;
+
+	if (! interacting)
+	{
+		ospSetObject(renderer, "model", coarseModel);
+		interacting = true;
+	}
+
+	lodTimer.start(lodIdle, this);
+}
+
+void QOSPRayWindow::endInteraction()
+{
+	lodTimer.stop();
+	if (! interacting)
+		return;
+
+	ospSetObject(renderer, "model", fullModel);
+	interacting = false;
+	updateGL();
+}
+
 void QOSPRayWindow::resizeGL(int width, int height)
 {
 	current_width = width;
@@ -181,6 +338,7 @@ void QOSPRayWindow::mousePressEvent(QMouseEvent * event)
 void QOSPRayWindow::mouseReleaseEvent(QMouseEvent * event)
 {
   lastMousePosition = event->pos();
+	endInteraction();
 }
 
 void QOSPRayWindow::mouseMoveEvent(QMouseEvent * event)
@@ -203,6 +361,9 @@ void QOSPRayWindow::mouseMoveEvent(QMouseEvent * event)
 			cameraEditor.zoom(dy);
     }
 
+	if (event->buttons() & (Qt::LeftButton | Qt::RightButton))
+		startInteraction();
+
   lastMousePosition = event->pos();
   updateGL();
 }
@@ -26,6 +26,7 @@
 
 #include "CameraEditor.h"
 #include "Camera.h"
+#include "Volume.h"
 
 class QOSPRayWindow : public QGLWidget
 {
@@ -52,6 +53,18 @@ public:
 
 	void saveImage(std::string filename);
 
+	// Render any refinement passes still due, so the frame buffer holds the final image
+	void finishRefinement();
+
+	// Volume whose bricks (if paged) follow the camera
+	void setVolume(Volume *v) { volume = v; }
+
+	// The renderer's model, which the window now owns, and the mesh in
+	// it (or NULL).  While the camera is being dragged a model with the
+	// mesh and a coarse level of the volume is rendered instead; the
+	// levels are built the first time that's needed.
+	void setModel(OSPModel full, OSPTriangleMesh mesh);
+
 protected:
 
   /*! Parent Qt window. */
@@ -66,6 +79,7 @@ protected:
   virtual void keyPressEvent(QKeyEvent * event);
   virtual void mouseReleaseEvent(QMouseEvent * event);
   virtual void mouseMoveEvent(QMouseEvent * event);
+  virtual void timerEvent(QTimerEvent * event);
 
   /*! frame counter */
   long frameCount;
@@ -95,6 +109,28 @@ protected:
   OSPRenderer renderer;
 
 	CameraEditor cameraEditor;
+	Volume *volume;
 
 	int current_width, current_height;
+
+	/*! progressive refinement: passes to render after each change, the
+	    pass we're on, and whether the next paint is one of them */
+	int progressivePasses;
+	int refinePass;
+	bool refining;
+	QBasicTimer refineTimer;
+
+	/*! level of detail: the models, the mesh they share, whether the
+	    coarse one has been tried for this volume and is in use, and how
+	    long input must be idle (ms) before going back to full */
+	OSPModel fullModel, coarseModel;
+	OSPTriangleMesh mesh;
+	bool coarseTried;
+	bool interacting;
+	int lodIdle;
+	QBasicTimer lodTimer;
+
+	void buildCoarseModel();
+	void startInteraction();
+	void endInteraction();
 };
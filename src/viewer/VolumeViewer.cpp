@@ -86,13 +86,16 @@ VolumeViewer::UpdateModel()
 	ospCommit(model);  
 
 	ospSetObject(renderer, "model", model);
+	osprayWindow->setModel(model, currentMesh);
 
 	OSPModel dmodel = ospNewModel();
 	ospCommit(dmodel);
 
 	ospSetObject(renderer, "dynamic_model", dmodel);
+	ospRelease(dmodel);
 
 	ospCommit(renderer);
+	osprayWindow->setVolume(currentVolume);
 	osprayWindow->setRenderingEnabled(true);
 }
 
@@ -135,7 +138,7 @@ VolumeViewer::resetCamera()
 void
 VolumeViewer::openVolume()
 {
-  QString filename = QFileDialog::getOpenFileName(this, tr("Load Volume"), ".", "volumes (*.vol *.vti)");
+  QString filename = QFileDialog::getOpenFileName(this, tr("Load Volume"), ".", "volumes (*.vol *.vti *.brk)");
 
   if(filename.isEmpty())
     return;
@@ -375,6 +378,7 @@ VolumeViewer::record()
 
 		char buf[256];
 		sprintf(buf, "frame-%04d.png", i);
+		osprayWindow->finishRefinement();
 		osprayWindow->saveImage(std::string(buf));
 	}
 }
@@ -55,6 +55,9 @@ class VolumeViewer : public QMainWindow {
   //! A string description of this class.
   std::string toString() const { return("VolumeViewer"); }
 
+  //! Keep at most n timesteps of a series loaded, reading ahead in the background (0: load all)
+  void setSeriesWindow(int n) { volumeSeries.SetWindow(n); }
+
   //! Load an data from a file
   void importFromFile(const std::string &filename);
 
@@ -41,6 +41,7 @@ syntax(char *a)
 	std::cerr << "    -viewsize <width>x<height>           : force OSPRay view size to 'width'x'height'"    << std::endl;
 	std::cerr << "    -viewup <x> <y> <z>                  : set viewport up vector to ('x', 'y', 'z')"     << std::endl;
 	std::cerr << "    -module <moduleName>                 : load the module 'moduleName'"                  << std::endl;
+	std::cerr << "    -window <n>                          : keep 'n' timesteps of a series loaded, read ahead" << std::endl;
 	std::cerr << " "                                                                                        << std::endl;
 	exit(1);
 }
@@ -76,6 +77,7 @@ int main(int argc, char *argv[]) {
   int viewSizeHeight = 0;
   osp::vec3f viewUp(0.f);
   bool showFrameRate = false;
+  int seriesWindow = 0;
 
   //! Parse the optional command line arguments.
   for (int i=1 ; i < argc ; i++) {
@@ -93,6 +95,12 @@ int main(int argc, char *argv[]) {
       showFrameRate = true;
       std::cout << "set show frame rate" << std::endl;
 
+    } else if (arg == "-window") {
+
+      if (i + 1 >= argc) throw std::runtime_error("missing <n> argument");
+      seriesWindow = atoi(argv[++i]);
+      std::cout << "got series window = " << seriesWindow << std::endl;
+
     } else if (arg == "-transferfunction") {
 
       if (i + 1 >= argc) throw std::runtime_error("missing <filename> argument");
@@ -176,6 +184,8 @@ int main(int argc, char *argv[]) {
   //! Set the window size if specified.
   if (viewSizeWidth != 0 && viewSizeHeight != 0) volumeViewer->getWindow()->setFixedSize(viewSizeWidth, viewSizeHeight);
 
+	volumeViewer->setSeriesWindow(seriesWindow);
+
 	if (volname != "")
 		volumeViewer->importFromFile(volname);
 	else if (statename != "")
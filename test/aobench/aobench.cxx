@@ -0,0 +1,77 @@
+#include <iostream>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "Renderer.h"
+
+// Time per tile for an isosurface with ambient occlusion at 16, 64 and
+// 256 AO rays per hit.  Every pixel that sees the surface starts that
+// many AO rays, so this mostly measures the AO ray queues.
+//
+// usage: aobench volume.vol [w h [frames [iso [radius]]]]
+//   iso: isovalue as a fraction of the data range (0.5)
+//   radius: AO radius in voxels (8)
+
+#define TILE_SIZE 64
+
+static double
+now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int
+main(int argc, char **argv)
+{
+	ospInit(&argc, (const char **)argv);
+
+	if (argc < 2)
+	{
+		std::cerr << "usage: " << argv[0] << " volume.vol [w h [frames [iso [radius]]]]\n";
+		exit(1);
+	}
+
+	int w = argc > 3 ? atoi(argv[2]) : 1024;
+	int h = argc > 3 ? atoi(argv[3]) : 1024;
+	int frames = argc > 4 ? atoi(argv[4]) : 4;
+	float f = argc > 5 ? atof(argv[5]) : 0.5;
+	float radius = argc > 6 ? atof(argv[6]) : 8.0;
+
+	Renderer r(w, h);
+	r.Load(argv[1]);
+
+	std::vector<osp::vec2f> alphas;
+	alphas.push_back(osp::vec2f(0.0, 0.0));
+	alphas.push_back(osp::vec2f(1.0, 0.0));
+	r.getTransferFunction().SetAlphas(alphas);
+	r.getTransferFunction().commit(r.getRenderer());
+
+	float m, M;
+	r.getVolume()->GetMinMax(m, M);
+	float iso = m + f*(M - m);
+	r.getVolume()->SetIsovalues(1, &iso);
+	r.getVolume()->commit();
+
+	int tiles = ((w + TILE_SIZE - 1) / TILE_SIZE) * ((h + TILE_SIZE - 1) / TILE_SIZE);
+
+	int counts[] = {16, 64, 256};
+	for (int i = 0; i < 3; i++)
+	{
+		ospSet1i(r.getRenderer(), "AO number", counts[i]);
+		ospSet1f(r.getRenderer(), "AO radius", radius);
+		ospCommit(r.getRenderer());
+
+		r.getWindow()->render(r.getRenderer());
+
+		double t = now();
+		for (int j = 0; j < frames; j++)
+			r.getWindow()->render(r.getRenderer());
+		t = (now() - t) / frames;
+
+		std::cout << "AO number " << counts[i] << ": " << t << " s/frame, " << 1e3 * t / tiles << " ms/tile\n";
+	}
+
+	return 0;
+}
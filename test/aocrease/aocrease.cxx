@@ -0,0 +1,130 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "Renderer.h"
+
+// Checks that ambient occlusion sees isosurfaces.  The isosurface is a
+// V-shaped groove running along y and opening towards the default
+// camera; AO rays from the bottom of the groove hit the opposite wall,
+// those from high up the walls mostly escape.  So with AO on the bottom
+// should come out darker, relative to the walls, than with it off.
+//
+// Writes aocrease.vol and aocrease.raw to the current directory.
+//
+// usage: aocrease [n [w h [radius]]]
+//   n: volume edge, in voxels (128)
+//   radius: AO radius in voxels (n/8)
+
+static void
+write_groove(int n)
+{
+	std::vector<float> v((size_t)n*n*n);
+
+	// Positive in front of the walls, where AO rays go, so the gradient
+	// points out of the groove
+
+	float xc = 0.5*(n - 1), z0 = 0.85*n;
+	for (int k = 0; k < n; k++)
+		for (int j = 0; j < n; j++)
+			for (int i = 0; i < n; i++)
+				v[((size_t)k*n + j)*n + i] = (z0 - k) - fabs(i - xc);
+
+	std::ofstream raw("aocrease.raw", std::ios::binary);
+	raw.write((char *)&v[0], v.size()*sizeof(float));
+	raw.close();
+
+	std::ofstream vol("aocrease.vol");
+	vol << n << " " << n << " " << n << " float aocrease.raw\n";
+	vol.close();
+}
+
+// Mean of r+g+b over a 5x5 block of pixels around where p lands
+
+static float
+brightness(Renderer& r, const uint32_t *pixels, int w, int h, const osp::vec3f& p)
+{
+	float sx, sy;
+	if (! r.getCamera().project(p, sx, sy))
+	{
+		std::cerr << "test point is behind the camera\n";
+		exit(1);
+	}
+
+	int px = (int)(sx * w), py = (int)(sy * h);
+	float sum = 0;
+	int count = 0;
+	for (int y = py - 2; y <= py + 2; y++)
+		for (int x = px - 2; x <= px + 2; x++)
+			if (x >= 0 && x < w && y >= 0 && y < h)
+			{
+				uint32_t c = pixels[y*w + x];
+				sum += (c & 0xff) + ((c >> 8) & 0xff) + ((c >> 16) & 0xff);
+				count++;
+			}
+
+	return count ? sum / count : 0;
+}
+
+// Brightness of the bottom of the groove over that of the walls
+
+static float
+crease_ratio(Renderer& r, OSPFrameBuffer fb, int w, int h, int n, int ao, float radius)
+{
+	ospSet1i(r.getRenderer(), "AO number", ao);
+	ospSet1f(r.getRenderer(), "AO radius", radius);
+	ospCommit(r.getRenderer());
+
+	ospRenderFrame(fb, r.getRenderer());
+	const uint32_t *pixels = (const uint32_t *)ospMapFrameBuffer(fb);
+
+	float xc = 0.5*(n - 1), yc = 0.5*(n - 1), z0 = 0.85*n, d = 0.35*n;
+	float bottom = brightness(r, pixels, w, h, osp::vec3f(xc, yc, z0));
+	float left   = brightness(r, pixels, w, h, osp::vec3f(xc - d, yc, z0 - d));
+	float right  = brightness(r, pixels, w, h, osp::vec3f(xc + d, yc, z0 - d));
+
+	ospUnmapFrameBuffer(pixels, fb);
+
+	std::cout << "AO number " << ao << ": bottom " << bottom << ", walls " << left << " " << right << "\n";
+	return bottom / (0.5*(left + right));
+}
+
+int
+main(int argc, char **argv)
+{
+	ospInit(&argc, (const char **)argv);
+
+	int n = argc > 1 ? atoi(argv[1]) : 128;
+	int w = argc > 3 ? atoi(argv[2]) : 512;
+	int h = argc > 3 ? atoi(argv[3]) : 512;
+	float radius = argc > 4 ? atof(argv[4]) : n / 8.0;
+
+	write_groove(n);
+
+	Renderer r(w, h);
+	r.Load("aocrease.vol");
+
+	std::vector<osp::vec2f> alphas;
+	alphas.push_back(osp::vec2f(0.0, 0.0));
+	alphas.push_back(osp::vec2f(1.0, 0.0));
+	r.getTransferFunction().SetAlphas(alphas);
+	r.getTransferFunction().commit(r.getRenderer());
+
+	float iso = 0;
+	r.getVolume()->SetIsovalues(1, &iso);
+	r.getVolume()->commit();
+
+	OSPFrameBuffer fb = ospNewFrameBuffer(osp::vec2i(w, h), OSP_RGBA_I8);
+
+	float off = crease_ratio(r, fb, w, h, n, 0, radius);
+	float on  = crease_ratio(r, fb, w, h, n, 64, radius);
+
+	ospRelease(fb);
+
+	bool ok = on < 0.9 * off;
+	std::cout << "bottom / walls: " << off << " without AO, " << on << " with" << (ok ? "" : " (not darker)") << "\n";
+	return ok ? 0 : 1;
+}
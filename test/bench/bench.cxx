@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Renderer.h"
+#include "perlin.h"
+
+// Headless render benchmark.  Renders a fixed set of scenes through
+// cinema's Renderer and reports, as JSON, per-frame latency percentiles,
+// primary rays per second and the memory high-water mark, so runs can
+// be compared from build to build.
+//
+// The scenes are the test/sphere distance field and a Perlin field (as
+// src/perlin/dump makes, with its default octaves, frequency and time),
+// each rendered
+//
+//		volume		volume rendering only, a fixed ramp transfer function
+//		iso				an isosurface at the middle of the data range only
+//		slices_ao	the isosurface with three slices and ambient occlusion
+//
+// from the default view at each image size.  The fields are written to
+// the scratch directory once and reused.
+//
+// OSPRay's thread count is fixed at ospInit, so with -t the benchmark
+// runs itself once per thread count and gathers the results.
+//
+// usage: bench [options]
+//   -s n          volume edge, in voxels (128)
+//   -r list       image sizes, e.g. 512x512,1920x1080 (the default)
+//   -t list       OSPRay thread counts, e.g. 1,4,16 (OSPRay's default)
+//   -n frames     timed frames per scene (20)
+//   -w frames     untimed warm-up frames per scene (2)
+//   -d dir        scratch directory for the generated volumes (.)
+//   -o file       write the JSON here rather than to stdout
+
+static double
+now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Peak resident set so far, in kB
+
+static long
+highWater()
+{
+	std::ifstream in("/proc/self/status");
+	std::string line;
+	while (std::getline(in, line))
+		if (line.compare(0, 6, "VmHWM:") == 0)
+			return atol(line.c_str() + 6);
+
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+static bool
+exists(const std::string& name)
+{
+	return access(name.c_str(), R_OK) == 0;
+}
+
+static bool
+writeVolume(const std::string& dir, const std::string& name, int s, float *voxels)
+{
+	std::string raw = name + ".raw";
+
+	FILE *f = fopen((dir + "/" + raw).c_str(), "wb");
+	if (! f || fwrite(voxels, sizeof(float), (size_t)s*s*s, f) != (size_t)s*s*s)
+	{
+		std::cerr << "unable to write " << dir << "/" << raw << "\n";
+		if (f) fclose(f);
+		return false;
+	}
+	fclose(f);
+
+	f = fopen((dir + "/" + name + ".vol").c_str(), "w");
+	if (! f)
+	{
+		std::cerr << "unable to write " << dir << "/" << name << ".vol\n";
+		return false;
+	}
+	fprintf(f, "%d %d %d float %s\n", s, s, s, raw.c_str());
+	fclose(f);
+	return true;
+}
+
+// The benchmark volumes, generated if they aren't already there
+
+static bool
+generate(const std::string& dir, int s, std::vector<std::string>& names)
+{
+	std::stringstream ss;
+	ss << s;
+
+	std::string sphere = "bench_sphere_" + ss.str();
+	std::string perlin = "bench_perlin_" + ss.str();
+
+	names.clear();
+	names.push_back(sphere);
+	names.push_back(perlin);
+
+	std::vector<float> buf((size_t)s*s*s);
+
+	if (! exists(dir + "/" + sphere + ".vol"))
+	{
+		std::cerr << "generating " << sphere << "\n";
+
+		float *b = &buf[0];
+		for (int i = 0; i < s; i++)
+		{
+			float x = -1.0 + 2.0 *(i / (s-1.0));
+			for (int j = 0; j < s; j++)
+			{
+				float y = -1.0 + 2.0 *(j / (s-1.0));
+				for (int k = 0; k < s; k++)
+				{
+					float z = -1.0 + 2.0 *(k / (s-1.0));
+					*b++ = sqrt(x*x + y*y + z*z);
+				}
+			}
+		}
+
+		if (! writeVolume(dir, sphere, s, &buf[0]))
+			return false;
+	}
+
+	if (! exists(dir + "/" + perlin + ".vol"))
+	{
+		std::cerr << "generating " << perlin << "\n";
+
+		SetOctaveCount(4);
+		SetFrequency(8);
+		SetPersistence(0.5);
+		PerlinT(&buf[0], s, s, s, 3.1415926);
+
+		if (! writeVolume(dir, perlin, s, &buf[0]))
+			return false;
+	}
+
+	return true;
+}
+
+enum Mode { VOLUME, ISO, SLICES_AO };
+static const char *modeNames[] = { "volume", "iso", "slices_ao" };
+
+static void
+setup(Renderer& r, Mode mode)
+{
+	int x, y, z;
+	float m, M;
+	r.getVolume()->GetDimensions(x, y, z);
+	r.getVolume()->GetMinMax(m, M);
+
+	std::vector<osp::vec2f> alphas;
+	alphas.push_back(osp::vec2f(0.0, 0.0));
+	if (mode == VOLUME)
+	{
+		alphas.push_back(osp::vec2f(0.3, 0.0));
+		alphas.push_back(osp::vec2f(1.0, 0.5));
+	}
+	else
+		alphas.push_back(osp::vec2f(1.0, 0.0));
+
+	r.getTransferFunction().SetAlphas(alphas);
+	r.getTransferFunction().commit(r.getRenderer());
+
+	float iso = 0.5 * (m + M);
+	r.getVolume()->SetIsovalues(mode == VOLUME ? 0 : 1, &iso);
+	r.getVolume()->commit();
+
+	for (int i = 0; i < 3; i++)
+	{
+		r.getSlices().SetValue(i, 0.5f);
+		r.getSlices().SetVisible(i, mode == SLICES_AO);
+		r.getSlices().SetClip(i, false);
+	}
+	r.getSlices().commit(r.getRenderer(), r.getVolume());
+
+	int d = x > y ? x > z ? x : z : y > z ? y : z;
+	r.getRenderProperties().setNumAOSamples(mode == SLICES_AO ? 16 : 0);
+	r.getRenderProperties().setAORadius(mode == SLICES_AO ? d / 8.0 : 0.0);
+	r.getRenderProperties().commit();
+}
+
+// Nearest-rank percentile of sorted latencies
+
+static double
+percentile(const std::vector<double>& t, double p)
+{
+	int i = (int)ceil(p / 100.0 * t.size()) - 1;
+	return t[std::max(0, std::min(i, (int)t.size() - 1))];
+}
+
+static void
+scene(Writer<StringBuffer>& out, Renderer& r, const std::string& volume, Mode mode, int w, int h, int warmup, int frames)
+{
+	setup(r, mode);
+
+	for (int i = 0; i < warmup; i++)
+		r.RenderFrame();
+
+	std::vector<double> t(frames);
+	double total = 0;
+	for (int i = 0; i < frames; i++)
+	{
+		double t0 = now();
+		r.RenderFrame();
+		t[i] = now() - t0;
+		total += t[i];
+	}
+
+	std::sort(t.begin(), t.end());
+
+	out.StartObject();
+	out.String("volume");				out.String(volume.c_str());
+	out.String("mode");					out.String(modeNames[mode]);
+	out.String("width");				out.Int(w);
+	out.String("height");				out.Int(h);
+	out.String("frames");				out.Int(frames);
+	out.String("mean_s");				out.Double(total / frames);
+	out.String("min_s");				out.Double(t.front());
+	out.String("p50_s");				out.Double(percentile(t, 50));
+	out.String("p90_s");				out.Double(percentile(t, 90));
+	out.String("p99_s");				out.Double(percentile(t, 99));
+	out.String("max_s");				out.Double(t.back());
+	out.String("rays_per_s");		out.Double(((double)w) * h * frames / total);
+	out.String("vm_hwm_kb");		out.Int64(highWater());
+	out.EndObject();
+
+	std::cerr << volume << " " << modeNames[mode] << " " << w << "x" << h << ": "
+						<< percentile(t, 50) << " s/frame (p50)\n";
+}
+
+// One thread count: every scene, as a JSON object on stdout
+
+static int
+run(int threads, int size, const std::vector<std::pair<int, int> >& sizes, int warmup, int frames, const std::string& dir)
+{
+	std::vector<std::string> names;
+	if (! generate(dir, size, names))
+		return 1;
+
+	StringBuffer sbuf;
+	Writer<StringBuffer> out(sbuf);
+
+	out.StartObject();
+	out.String("threads");			out.Int(threads);
+	out.String("scenes");
+	out.StartArray();
+
+	for (size_t v = 0; v < names.size(); v++)
+		for (size_t s = 0; s < sizes.size(); s++)
+		{
+			int w = sizes[s].first, h = sizes[s].second;
+
+			Renderer r(w, h);
+			r.Load(dir + "/" + names[v] + ".vol");
+
+			for (int m = VOLUME; m <= SLICES_AO; m++)
+				scene(out, r, names[v], (Mode)m, w, h, warmup, frames);
+		}
+
+	out.EndArray();
+	out.String("vm_hwm_kb");			out.Int64(highWater());
+	out.EndObject();
+
+	std::cout << sbuf.GetString() << "\n";
+	return 0;
+}
+
+static bool
+parseList(const char *s, char sep, std::vector<int>& v)
+{
+	std::stringstream ss(s);
+	std::string item;
+	while (std::getline(ss, item, ','))
+	{
+		size_t x = item.find(sep);
+		if (sep && x == std::string::npos)
+			return false;
+		v.push_back(atoi(item.c_str()));
+		if (sep)
+			v.push_back(atoi(item.c_str() + x + 1));
+	}
+	return ! v.empty();
+}
+
+static void
+syntax(char *a)
+{
+	std::cerr << "usage: " << a << " [options]\n";
+	std::cerr << "options:\n";
+	std::cerr << "  -s n          volume edge, in voxels (128)\n";
+	std::cerr << "  -r list       image sizes (512x512,1920x1080)\n";
+	std::cerr << "  -t list       OSPRay thread counts, e.g. 1,4,16 (OSPRay's default)\n";
+	std::cerr << "  -n frames     timed frames per scene (20)\n";
+	std::cerr << "  -w frames     untimed warm-up frames per scene (2)\n";
+	std::cerr << "  -d dir        scratch directory for the generated volumes (.)\n";
+	std::cerr << "  -o file       write the JSON here (stdout)\n";
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	int size = 128, frames = 20, warmup = 2, child = -1;
+	std::vector<int> res, threads;
+	std::string dir = ".", output, resArg = "512x512,1920x1080";
+
+	// Takes the --osp: options out of argv
+	ospInit(&argc, (const char **)argv);
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-s") && i + 1 < argc) size = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc) resArg = argv[++i];
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc) { if (! parseList(argv[++i], 0, threads)) syntax(argv[0]); }
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc) frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-w") && i + 1 < argc) warmup = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc) dir = argv[++i];
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc) output = argv[++i];
+		else if (!strcmp(argv[i], "-T") && i + 1 < argc) child = atoi(argv[++i]);
+		else syntax(argv[0]);
+	}
+
+	if (! parseList(resArg.c_str(), 'x', res) || size < 2 || frames < 1 || warmup < 0)
+		syntax(argv[0]);
+
+	std::vector<std::pair<int, int> > sizes;
+	for (size_t i = 0; i < res.size(); i += 2)
+		sizes.push_back(std::make_pair(res[i], res[i+1]));
+
+	if (child >= 0)
+		return run(child, size, sizes, warmup, frames, dir);
+
+	// Make the volumes once, rather than in each run
+
+	std::vector<std::string> names;
+	if (! generate(dir, size, names))
+		exit(1);
+
+	if (threads.empty())
+		threads.push_back(0);
+
+	Document doc;
+	doc.SetObject();
+	doc.AddMember("volume_size", size, doc.GetAllocator());
+	doc.AddMember("warmup_frames", warmup, doc.GetAllocator());
+	doc.AddMember("frames", frames, doc.GetAllocator());
+
+	Value runs(kArrayType);
+
+	for (size_t t = 0; t < threads.size(); t++)
+	{
+		std::stringstream cmd;
+		cmd << "'" << argv[0] << "'";
+		if (threads[t] > 0)
+			cmd << " --osp:numthreads " << threads[t];
+		cmd << " -T " << threads[t] << " -s " << size << " -r " << resArg
+				<< " -n " << frames << " -w " << warmup << " -d '" << dir << "'";
+
+		FILE *p = popen(cmd.str().c_str(), "r");
+		std::string result;
+		char buf[4096];
+		size_t n;
+		while (p && (n = fread(buf, 1, sizeof(buf), p)) > 0)
+			result.append(buf, n);
+
+		if (! p || pclose(p) != 0)
+		{
+			std::cerr << "benchmark run with " << threads[t] << " threads failed\n";
+			exit(1);
+		}
+
+		Document r(&doc.GetAllocator());
+		r.Parse(result.c_str());
+		if (! r.IsObject())
+		{
+			std::cerr << "benchmark run with " << threads[t] << " threads gave no results\n";
+			exit(1);
+		}
+
+		runs.PushBack(r, doc.GetAllocator());
+	}
+
+	doc.AddMember("runs", runs, doc.GetAllocator());
+
+	StringBuffer sbuf;
+	PrettyWriter<StringBuffer> writer(sbuf);
+	doc.Accept(writer);
+
+	if (output != "")
+	{
+		std::ofstream out(output.c_str());
+		out << sbuf.GetString() << "\n";
+	}
+	else
+		std::cout << sbuf.GetString() << "\n";
+
+	return 0;
+}
@@ -0,0 +1,94 @@
+#include <iostream>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "Renderer.h"
+
+// Primary rays per second through a volume with and without empty-space
+// skipping.  First with a transfer function that is opaque only in a
+// narrow band of values, so most of a volume like test/sphere's is
+// transparent; then for an isosurface at the middle of that band, with
+// the volume itself transparent.
+//
+// usage: emptyspace volume.vol [w h [frames [lo hi]]]
+//   lo, hi: the opaque band as fractions of the data range (0.3 0.35)
+
+static double
+now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+time(Renderer& r, const char *what, int w, int h, int frames)
+{
+	double rate[2];
+	for (int skip = 0; skip < 2; skip++)
+	{
+		ospSet1i(r.getRenderer(), "empty space skipping", skip);
+		ospCommit(r.getRenderer());
+
+		r.getWindow()->render(r.getRenderer());
+
+		double t = now();
+		for (int i = 0; i < frames; i++)
+			r.getWindow()->render(r.getRenderer());
+		t = now() - t;
+
+		rate[skip] = ((double)w) * h * frames / t;
+		std::cout << what << (skip ? ", skipping:    " : ", no skipping: ") << rate[skip] << " rays/s (" << t / frames << " s/frame)\n";
+	}
+
+	std::cout << what << " speedup: x" << rate[1] / rate[0] << "\n";
+}
+
+int
+main(int argc, char **argv)
+{
+	ospInit(&argc, (const char **)argv);
+
+	if (argc < 2)
+	{
+		std::cerr << "usage: " << argv[0] << " volume.vol [w h [frames [lo hi]]]\n";
+		exit(1);
+	}
+
+	int w = argc > 3 ? atoi(argv[2]) : 1024;
+	int h = argc > 3 ? atoi(argv[3]) : 1024;
+	int frames = argc > 4 ? atoi(argv[4]) : 10;
+	float lo = argc > 6 ? atof(argv[5]) : 0.3;
+	float hi = argc > 6 ? atof(argv[6]) : 0.35;
+
+	Renderer r(w, h);
+	r.Load(argv[1]);
+
+	std::vector<osp::vec2f> alphas;
+	alphas.push_back(osp::vec2f(0.0, 0.0));
+	alphas.push_back(osp::vec2f(lo, 0.0));
+	alphas.push_back(osp::vec2f(0.5*(lo + hi), 1.0));
+	alphas.push_back(osp::vec2f(hi, 0.0));
+	alphas.push_back(osp::vec2f(1.0, 0.0));
+
+	r.getTransferFunction().SetAlphas(alphas);
+	r.getTransferFunction().commit(r.getRenderer());
+
+	time(r, "volume", w, h, frames);
+
+	float m, M;
+	r.getVolume()->GetMinMax(m, M);
+	float iso = m + 0.5*(lo + hi)*(M - m);
+
+	alphas.clear();
+	alphas.push_back(osp::vec2f(0.0, 0.0));
+	alphas.push_back(osp::vec2f(1.0, 0.0));
+	r.getTransferFunction().SetAlphas(alphas);
+	r.getTransferFunction().commit(r.getRenderer());
+
+	r.getVolume()->SetIsovalues(1, &iso);
+	r.getVolume()->commit();
+
+	time(r, "isosurface", w, h, frames);
+	return 0;
+}
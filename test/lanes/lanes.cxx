@@ -0,0 +1,94 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <glob.h>
+#include <stdlib.h>
+
+#include "Cinema.h"
+
+// Renders the same isosurface sweep with one lane and with several and
+// checks the images are byte for byte the same.  Each lane's volume has
+// to pick up the isovalues of the shot it renders, not of the one it
+// rendered last.
+//
+// Images are written to the current directory as cinema_0_* (one lane)
+// and cinema_1_* (several); any left from an earlier run are reused, so
+// run it in an empty directory.
+//
+// usage: lanes volume.vol [lanes [w h]]
+
+static bool
+same(const std::string& a, const std::string& b)
+{
+	std::ifstream fa(a.c_str(), std::ios::binary), fb(b.c_str(), std::ios::binary);
+	if (! fa || ! fb)
+		return false;
+
+	std::vector<char> da((std::istreambuf_iterator<char>(fa)), std::istreambuf_iterator<char>());
+	std::vector<char> db((std::istreambuf_iterator<char>(fb)), std::istreambuf_iterator<char>());
+	return da == db;
+}
+
+int
+main(int argc, char **argv)
+{
+	Cinema cinema(&argc, (const char **)argv);
+
+	if (argc < 2)
+	{
+		std::cerr << "usage: " << argv[0] << " volume.vol [lanes [w h]]\n";
+		exit(1);
+	}
+
+	int lanes = argc > 2 ? atoi(argv[2]) : 4;
+	int w = argc > 4 ? atoi(argv[3]) : 256;
+	int h = argc > 4 ? atoi(argv[4]) : 256;
+
+	Renderer r(w, h);
+	r.Load(argv[1]);
+
+	std::vector<int> phis, thetas;
+	phis.push_back(30);
+	thetas.push_back(20);
+	thetas.push_back(50);
+	cinema.AddVariable(new CameraVariable(phis, thetas));
+
+	std::vector<int> isovalues;
+	for (int i = 0; i < 10; i++)
+		isovalues.push_back((int)(20 + (i / 9.0)*60));
+	cinema.AddVariable(new IsosurfaceVariable(std::string("Iso"), isovalues));
+
+	cinema.setLanes(1);
+	cinema.Render(r, 0);
+
+	cinema.setLanes(lanes);
+	cinema.Render(r, 1);
+
+	r.getWindow()->finish();
+
+	glob_t g;
+	if (glob("cinema_0_*.png", 0, NULL, &g) || g.gl_pathc == 0)
+	{
+		std::cerr << "no images rendered\n";
+		exit(1);
+	}
+
+	int bad = 0;
+	for (size_t i = 0; i < g.gl_pathc; i++)
+	{
+		std::string a = g.gl_pathv[i];
+		std::string b = "cinema_1" + a.substr(8);
+		if (! same(a, b))
+		{
+			std::cerr << a << " and " << b << " differ\n";
+			bad++;
+		}
+	}
+
+	std::cout << g.gl_pathc << " images, " << bad << " differ with " << lanes << " lanes\n";
+	globfree(&g);
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "MinMax.h"
+
+// Compares ComputeMinMax against the original single-threaded scalar
+// loop from Volume::_setMinMax.
+//
+// usage: minmax [dim [reps]]   (volume is dim^3, default 512)
+
+static double
+now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+template<typename T>
+static void
+old_loop(T *ptr, size_t n, float& m, float& M)
+{
+	m = *ptr;
+	M = *ptr;
+	for (size_t i = 0; i < n; i++, ptr++)
+	{
+		if (m > *ptr) m = *ptr;
+		if (M < *ptr) M = *ptr;
+	}
+}
+
+template<typename T>
+static void
+bench(const char *name, T *v, size_t n, int reps)
+{
+	float m0 = v[0], M0 = v[0], m1, M1, m2, M2;
+	VoxelHistogram h;
+
+	double t = now();
+	for (int i = 0; i < reps; i++) old_loop(v, n, m0, M0);
+	double t0 = (now() - t) / reps;
+
+	t = now();
+	for (int i = 0; i < reps; i++) ComputeMinMax(v, n, m1, M1);
+	double t1 = (now() - t) / reps;
+
+	t = now();
+	for (int i = 0; i < reps; i++) ComputeMinMax(v, n, m2, M2, &h);
+	double t2 = (now() - t) / reps;
+
+	double gb = (n * sizeof(T)) / 1e9;
+
+	std::cout << name << ": " << n << " voxels\n";
+	std::cout << "  old loop:          " << t0*1000 << " ms (" << gb/t0 << " GB/s) " << m0 << " " << M0 << "\n";
+	std::cout << "  parallel:          " << t1*1000 << " ms (" << gb/t1 << " GB/s) " << m1 << " " << M1 << "  x" << t0/t1 << "\n";
+	std::cout << "  parallel + hist:   " << t2*1000 << " ms (" << gb/t2 << " GB/s) " << m2 << " " << M2 << "  x" << t0/t2 << "\n";
+
+	if (m0 != m1 || M0 != M1 || m0 != m2 || M0 != M2 || h.Total() != n)
+	{
+		std::cerr << "MISMATCH\n";
+		exit(1);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t d = argc > 1 ? atoi(argv[1]) : 512;
+	int reps = argc > 2 ? atoi(argv[2]) : 5;
+	size_t n = d*d*d;
+
+	float *f = new float[n];
+	unsigned char *u = new unsigned char[n];
+	unsigned short *us = new unsigned short[n];
+	short *ss = new short[n];
+
+	srand(0);
+	for (size_t i = 0; i < n; i++)
+	{
+		f[i] = (rand() / (float)RAND_MAX) * 200.0 - 100.0;
+		u[i] = rand() & 0xff;
+		us[i] = rand() & 0xffff;
+		ss[i] = (short)(rand() & 0xffff);
+	}
+
+	bench("float", f, n, reps);
+	bench("uchar", u, n, reps);
+	bench("ushort", us, n, reps);
+	bench("short", ss, n, reps);
+
+	delete[] f;
+	delete[] u;
+	delete[] us;
+	delete[] ss;
+	return 0;
+}
@@ -0,0 +1,20 @@
+# Shared by the tests that render through OSPRay.  They need OSPRay (with
+# the vis_renderer module) and the cinema and common libraries built in
+# ../../src/cinema.obj and ../../src/common.obj:
+#
+#   make OSPRAY_SRCDIR=/path/to/ospray OSPRAY_OBJDIR=/path/to/ospray/obj
+
+SRC = ../../src
+
+OSPRAY_CXXFLAGS = -O2 \
+	-I${OSPRAY_SRCDIR} \
+	-I${OSPRAY_SRCDIR}/ospray/include \
+	-I${OSPRAY_SRCDIR}/ospray/embree \
+	-I${OSPRAY_SRCDIR}/ospray/embree/common \
+	-I$(SRC)/common \
+	-I$(SRC)/cinema \
+	-I$(SRC)/cinema.obj \
+	-I$(SRC)
+
+OSPRAY_LIBS = -L${OSPRAY_OBJDIR} -L$(SRC)/cinema.obj -L$(SRC)/common.obj \
+	-lcinema -lcommon -lospray -lospray_embree -lpng -lpthread